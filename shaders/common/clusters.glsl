@@ -0,0 +1,27 @@
+// Point lights and their froxel lists, see LightClusters.h
+#include "frame.glsl"
+
+struct PointLight {
+    // xyz position, w 1 / range^2
+    vec4 positionInvSqrRange;
+    vec4 color;
+};
+
+layout (std430, binding = 2) readonly buffer Lights {
+    PointLight lights[];
+};
+// Per froxel: first entry in clusterLights and light count
+layout (std430, binding = 3) readonly buffer Clusters {
+    uvec2 clusters[];
+};
+layout (std430, binding = 4) readonly buffer ClusterLights {
+    uint clusterLights[];
+};
+
+// Froxel of a fragment, the depth slices are exponential in the view depth
+uint clusterIndex(vec2 fragCoord, float viewDepth)
+{
+    uvec2 tile = min(uvec2(fragCoord / clusterParams.xy), clusterSize.xy - 1u);
+    float slice = clamp(floor(log(viewDepth) * clusterParams.z + clusterParams.w), 0.0, float(clusterSize.z - 1u));
+    return (uint(slice) * clusterSize.y + tile.y) * clusterSize.x + tile.x;
+}
@@ -0,0 +1,8 @@
+// Per-draw data written by RenderQueue, every indirect command points at its entry through baseInstance
+struct DrawData {
+    mat4 model;
+    uvec4 material;
+};
+layout (std430, binding = 0) readonly buffer Draws {
+    DrawData draws[];
+};
@@ -0,0 +1,12 @@
+// Per-frame data, see FrameData.h
+layout (std140, binding = 0) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    // Clip space back to world space, for positions rebuilt from depth
+    mat4 inverseViewProjection;
+    vec4 camPos;
+    // Light grid, see LightClusters: tiles x, y, depth slices and light count
+    uvec4 clusterSize;
+    // Tile size in pixels, depth slice scale and bias
+    vec4 clusterParams;
+};
@@ -0,0 +1,221 @@
+// Direct light from the clustered point lights plus image based ambient light, shared by the forward pass
+// (pbr.frag) and the deferred lighting pass (deferred.frag)
+#include "surface.glsl"
+#include "frame.glsl"
+#include "clusters.glsl"
+
+#include "ggx.glsl"
+#include "hammersley.glsl"
+
+// IBL
+#ifdef USE_SH_IRRADIANCE
+// Diffuse irradiance as L2 spherical harmonics, already convolved with the cosine lobe
+uniform vec3 shIrradiance[9];
+#else
+uniform samplerCube irradianceMap;
+#endif
+uniform samplerCube prefilterMap;
+uniform sampler2D brdfLUT;
+
+// Functions
+float saturate(float x) { return max(0, min(1, x)); }
+float cot(float x) { return cos(x) / sin(x); }
+float acot(float x) { return atan(1 / x); }
+
+vec3 irradianceSH(vec3 n);
+
+float GeometrySchlickGGX(float NdotV, float roughness);
+float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness);
+vec3 fresnelSchlick(float cosTheta, vec3 F0);
+vec3 fresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness);
+
+vec3 uniformSampleSphere(float u1, float u2);
+void BRDF(vec3 V, vec3 L, vec3 N, float roughness, float metallic, vec3 f0, out vec3 diff, out vec3 spec);
+float smoothDistanceAtt(float squaredDistance, float invSqrAttRadius);
+
+// ----------------------------------------------------------------------------
+// HDR radiance leaving `worldPos` towards the camera, `fragCoord` selects the light cluster
+vec3 shadeSurface(Surface surface, vec3 worldPos, vec2 fragCoord)
+{
+    vec3 albedo     = surface.albedo;
+    float ao        = surface.ao;
+    float roughness = surface.roughness;
+    float metallic  = surface.metallic;
+    vec3 N          = surface.N;
+
+    vec3 V = normalize(camPos.xyz - worldPos);
+    vec3 R = reflect(-V, N); 
+
+    // calculate reflectance at normal incidence; if dia-electric (like plastic) use F0 
+    // of 0.04 and if it's a metal, use the albedo color as F0 (metallic workflow)    
+    vec3 F0 = vec3(0.04); 
+    F0 = mix(F0, albedo, metallic);
+
+    // reflectance equation, over the lights whose range reaches this fragment's froxel
+    vec3 Lo = vec3(0.0);
+    float viewDepth = -(view * vec4(worldPos, 1.0)).z;
+    uvec2 cluster = clusters[clusterIndex(fragCoord, viewDepth)];
+    for(uint i = 0u; i < cluster.y; ++i) 
+    {
+        PointLight light = lights[clusterLights[cluster.x + i]];
+
+        // calculate per-light radiance, inverse square falloff windowed to zero at the light's range
+        vec3 toLight = light.positionInvSqrRange.xyz - worldPos;
+        float distanceSquared = max(dot(toLight, toLight), 0.0001);
+        vec3 L = toLight * inversesqrt(distanceSquared);
+        vec3 H = normalize(V + L);
+        float attenuation = smoothDistanceAtt(distanceSquared, light.positionInvSqrRange.w) / distanceSquared;
+        vec3 radiance = light.color.rgb * attenuation;
+
+        // Cook-Torrance BRDF
+        float NDF = DistributionGGX(N, H, roughness);   
+        float G   = GeometrySmith(N, V, L, roughness);    
+        vec3 F    = fresnelSchlick(max(dot(H, V), 0.0), F0);        
+        
+        vec3 numerator    = NDF * G * F;
+        float denominator = 4.0 * max(dot(N, V), 0.0) * max(dot(N, L), 0.0) + 0.0001; // + 0.0001 to prevent divide by zero
+        vec3 specular = numerator / denominator;
+        
+         // kS is equal to Fresnel
+        vec3 kS = F;
+        // for energy conservation, the diffuse and specular light can't
+        // be above 1.0 (unless the surface emits light); to preserve this
+        // relationship the diffuse component (kD) should equal 1.0 - kS.
+        vec3 kD = vec3(1.0) - kS;
+        // multiply kD by the inverse metalness such that only non-metals 
+        // have diffuse lighting, or a linear blend if partly metal (pure metals
+        // have no diffuse light).
+        kD *= 1.0 - metallic;	                
+            
+        // scale light by NdotL
+        float NdotL = max(dot(N, L), 0.0);        
+
+        // add to outgoing radiance Lo
+        Lo += (kD * albedo / PI + specular) * radiance * NdotL; // note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again
+    }   
+    
+    // ambient lighting (we now use IBL as the ambient term)
+    vec3 F = fresnelSchlickRoughness(max(dot(N, V), 0.0), F0, roughness);
+    
+    vec3 kS = F;
+    vec3 kD = 1.0 - kS;
+    kD *= 1.0 - metallic;	  
+    
+#ifdef USE_SH_IRRADIANCE
+    vec3 irradiance = irradianceSH(N);
+#else
+    vec3 irradiance = texture(irradianceMap, N).rgb;
+#endif
+    vec3 diffuse      = irradiance * albedo;
+    
+    // sample both the pre-filter map and the BRDF lut and combine them together as per the Split-Sum approximation to get the IBL specular part.
+    // The roughest level follows BakeSettings::prefilter_mips, whatever the map was baked with
+    float MAX_REFLECTION_LOD = float(textureQueryLevels(prefilterMap) - 1);
+    vec3 prefilteredColor = textureLod(prefilterMap, R,  roughness * MAX_REFLECTION_LOD).rgb;    
+    vec2 brdf  = texture(brdfLUT, vec2(max(dot(N, V), 0.0), roughness)).rg;
+    vec3 specular = prefilteredColor * (F * brdf.x + brdf.y);
+
+    vec3 ambient = (kD * diffuse + specular) * ao;
+    
+    vec3 color = ambient + Lo;
+
+    return color;
+}
+
+// ----------------------------------------------------------------------------
+vec3 toDisplay(vec3 color)
+{
+    // HDR tonemapping
+    color = color / (color + vec3(1.0));
+    // gamma correct
+    return pow(color, vec3(1.0/2.2));
+}
+
+vec3 uniformSampleSphere(float u1, float u2) {
+
+    float phi = 2.0 * PI * u2;
+    float cosTheta = 1.0 - 2.0 * u1;
+    float sinTheta = sqrt (max(0.0f, 1.0 - cosTheta * cosTheta ));
+
+    return vec3 ( sinTheta * cos ( phi ), sinTheta * sin( phi ), cosTheta );
+}
+
+void BRDF(vec3 V, vec3 L, vec3 N, float roughness, float metallic, vec3 f0, out vec3 diff, out vec3 spec) {
+
+    float NdotV = abs(dot(N, V)) + 1e-5f;
+    vec3 H = normalize(V + L);
+    float LdotH = max(dot(L, H), 0.0);
+    float NdotH = max(dot(N, H), 0.0);
+    float NdotL = max(dot(N, L), 0.0);
+
+    // Specular
+    vec3 F = fresnelSchlick(LdotH, f0);
+    float G = GeometrySmith(N, V, L, roughness);
+    float D = DistributionGGX(N, H, roughness);
+    vec3 Fr = D * F * G / PI;
+
+    // Diffuse
+    vec3 Fd = 1 - Fr;
+    Fd *= 1.0 - metallic;
+
+    spec = F;
+    diff = Fd;
+}
+
+#ifdef USE_SH_IRRADIANCE
+// ----------------------------------------------------------------------------
+vec3 irradianceSH(vec3 n)
+{
+    vec3 result = shIrradiance[0] * 0.282095
+        + shIrradiance[1] * 0.488603 * n.y
+        + shIrradiance[2] * 0.488603 * n.z
+        + shIrradiance[3] * 0.488603 * n.x
+        + shIrradiance[4] * 1.092548 * n.x * n.y
+        + shIrradiance[5] * 1.092548 * n.y * n.z
+        + shIrradiance[6] * 0.315392 * (3.0 * n.z * n.z - 1.0)
+        + shIrradiance[7] * 1.092548 * n.x * n.z
+        + shIrradiance[8] * 0.546274 * (n.x * n.x - n.y * n.y);
+    return max(result, vec3(0.0));
+}
+#endif
+
+// ----------------------------------------------------------------------------
+float GeometrySchlickGGX(float NdotV, float roughness)
+{
+    float r = (roughness + 1.0);
+    float k = (r*r) / 8.0;
+
+    float nom   = NdotV;
+    float denom = NdotV * (1.0 - k) + k;
+
+    return nom / denom;
+}
+// ----------------------------------------------------------------------------
+float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness)
+{
+    float NdotV = max(dot(N, V), 0.0);
+    float NdotL = max(dot(N, L), 0.0);
+    float ggx2 = GeometrySchlickGGX(NdotV, roughness);
+    float ggx1 = GeometrySchlickGGX(NdotL, roughness);
+
+    return ggx1 * ggx2;
+}
+// ----------------------------------------------------------------------------
+vec3 fresnelSchlick(float cosTheta, vec3 F0)
+{
+    return F0 + (1.0 - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+}
+// ----------------------------------------------------------------------------
+vec3 fresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness)
+{
+    return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+}   
+// ----------------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------
+float smoothDistanceAtt(float squaredDistance, float invSqrAttRadius) 
+{
+    float factor = squaredDistance * invSqrAttRadius;
+    float smoothFactor = saturate(1.0 - factor*factor);
+    return smoothFactor*smoothFactor;
+}
@@ -0,0 +1,98 @@
+// Material inputs of the forward and G-buffer passes: the glTF factors written by RenderQueue times the
+// material's maps. The including shader declares TexCoords, WorldPos, Normal and MaterialIndex.
+#include "surface.glsl"
+
+// material parameters
+//uniform vec3 albedo;
+//uniform float metallic;
+//uniform float roughness;
+#ifndef USE_ORM_MAP
+uniform float ao;
+#endif
+
+// Material Textures
+#ifdef HAS_ALBEDO_MAP
+uniform sampler2D albedoMap;
+#endif
+#ifdef HAS_NORMAL_MAP
+uniform sampler2D normalMap;
+#endif
+#ifdef USE_ORM_MAP
+#ifdef HAS_ORM_MAP
+// R occlusion, G roughness, B metallic
+uniform sampler2D ormMap;
+#endif
+#else
+uniform sampler2D metallicMap;
+uniform sampler2D roughnessMap;
+#endif
+// glTF material factors written by RenderQueue, the textures are multiplied with them
+struct MaterialData {
+    vec4 baseColorFactor;
+    vec4 metallicRoughness; // x metallic, y roughness
+};
+layout (std430, binding = 1) readonly buffer Materials {
+    MaterialData materials[];
+};
+
+// ----------------------------------------------------------------------------
+// Easy trick to get tangent-normals to world-space to keep PBR code simplified.
+// Don't worry if you don't get what's going on; you generally want to do normal 
+// mapping the usual way for performance anways; I do plan make a note of this 
+// technique somewhere later in the normal mapping tutorial.
+#ifdef HAS_NORMAL_MAP
+vec3 getNormalFromMap()
+{
+    // Only XY are read so BC5 normal maps work too, Z is rebuilt from the unit length
+    vec3 tangentNormal;
+    tangentNormal.xy = texture(normalMap, TexCoords).xy * 2.0 - 1.0;
+    tangentNormal.z = sqrt(max(1.0 - dot(tangentNormal.xy, tangentNormal.xy), 0.0));
+
+    vec3 Q1  = dFdx(WorldPos);
+    vec3 Q2  = dFdy(WorldPos);
+    vec2 st1 = dFdx(TexCoords);
+    vec2 st2 = dFdy(TexCoords);
+
+    vec3 N   = normalize(Normal);
+    vec3 T  = normalize(Q1*st2.t - Q2*st1.t);
+    vec3 B  = -normalize(cross(N, T));
+    mat3 TBN = mat3(T, B, N);
+
+    return normalize(TBN * tangentNormal);
+}
+#endif
+
+// ----------------------------------------------------------------------------
+Surface materialSurface()
+{
+#ifdef HAS_ALBEDO_MAP
+    vec3 albedo     = pow(texture(albedoMap, TexCoords).rgb, vec3(2.2));
+#else
+    vec3 albedo     = vec3(1.0);
+#endif
+#ifdef USE_ORM_MAP
+#ifdef HAS_ORM_MAP
+    vec3 orm        = texture(ormMap, TexCoords).rgb;
+#else
+    vec3 orm        = vec3(1.0);
+#endif
+    float ao        = orm.r;
+    float roughness = orm.g;
+    float metallic  = orm.b;
+#else
+    float metallic  = texture(metallicMap, TexCoords).r;
+    float roughness = texture(roughnessMap, TexCoords).r;
+#endif
+    MaterialData material = materials[MaterialIndex];
+    albedo    *= material.baseColorFactor.rgb;
+    metallic  *= material.metallicRoughness.x;
+    roughness *= material.metallicRoughness.y;
+  
+#ifdef HAS_NORMAL_MAP
+    vec3 N = getNormalFromMap();
+#else
+    vec3 N = normalize(Normal);
+#endif
+
+    return Surface(albedo, ao, roughness, metallic, N);
+}
@@ -0,0 +1,27 @@
+// Shading inputs of one pixel, from the material (common/material.glsl) or from the G-buffer (deferred.frag)
+struct Surface {
+    vec3 albedo;
+    float ao;
+    float roughness;
+    float metallic;
+    vec3 N;
+};
+
+// ----------------------------------------------------------------------------
+// Octahedral normal packing for the two channel G-buffer target, the octahedron folded into [0, 1]^2
+vec2 encodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return e * 0.5 + 0.5;
+}
+// ----------------------------------------------------------------------------
+vec3 decodeNormal(vec2 e)
+{
+    e = e * 2.0 - 1.0;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
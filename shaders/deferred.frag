@@ -0,0 +1,38 @@
+#version 460 core
+// Lighting pass of the deferred path, shades the G-buffer with the same code as pbr.frag
+out vec4 FragColor;
+in vec2 TexCoords;
+
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gOrm;
+uniform sampler2D gDepth;
+
+// USE_SH_IRRADIANCE is the only variant key that matters here, see PbrFeatures.h
+#include "common/lighting.glsl"
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, texel, 0).r;
+    // Nothing was drawn, the skybox fills it in
+    if (depth == 1.0) {
+        discard;
+    }
+
+    vec4 orm = texelFetch(gOrm, texel, 0);
+    Surface surface;
+    surface.albedo = texelFetch(gAlbedo, texel, 0).rgb;
+    surface.ao = orm.r;
+    surface.roughness = orm.g;
+    surface.metallic = orm.b;
+    surface.N = decodeNormal(texelFetch(gNormal, texel, 0).rg);
+
+    vec4 worldPos = inverseViewProjection * vec4(vec3(TexCoords, depth) * 2.0 - 1.0, 1.0);
+    worldPos /= worldPos.w;
+
+    vec3 color = shadeSurface(surface, worldPos.xyz, gl_FragCoord.xy);
+    FragColor = vec4(toDisplay(color), 1.0);
+    // Lets the skybox test against the G-buffer depth
+    gl_FragDepth = depth;
+}
@@ -0,0 +1,6 @@
+#version 460 core
+// Depth pre-pass, the depth test and write are all there is
+
+void main()
+{
+}
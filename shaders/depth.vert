@@ -0,0 +1,17 @@
+#version 460 core
+// Depth pre-pass, positions only. gl_Position is computed exactly like in pbr.vert.
+layout (location = 0) in vec3 aPos;
+
+invariant gl_Position;
+
+#include "common/draws.glsl"
+
+#include "common/frame.glsl"
+
+void main()
+{
+    mat4 model = draws[gl_BaseInstance + gl_InstanceID].model;
+    vec3 WorldPos = vec3(model * vec4(aPos, 1.0));
+
+    gl_Position =  projection * view * vec4(WorldPos, 1.0);
+}
@@ -0,0 +1,22 @@
+#version 460 core
+// Geometry pass of the deferred path: the material is evaluated once per pixel and written to the
+// G-buffer, lighting happens afterwards in deferred.frag for the visible surface only
+layout (location = 0) out vec4 gAlbedo;
+layout (location = 1) out vec2 gNormal;
+layout (location = 2) out vec4 gOrm;
+
+in vec2 TexCoords;
+in vec3 WorldPos;
+in vec3 Normal;
+flat in uint MaterialIndex;
+
+// Same material variant keys as pbr.frag, see PbrFeatures.h
+#include "common/material.glsl"
+
+void main()
+{
+    Surface surface = materialSurface();
+    gAlbedo = vec4(surface.albedo, 1.0);
+    gNormal = encodeNormal(surface.N);
+    gOrm = vec4(surface.ao, surface.roughness, surface.metallic, 1.0);
+}
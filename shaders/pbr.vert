@@ -6,16 +6,23 @@ layout (location = 2) in vec2 aTexCoords;
 out vec2 TexCoords;
 out vec3 WorldPos;
 out vec3 Normal;
+flat out uint MaterialIndex;
+// Must match depth.vert exactly for the GL_EQUAL pass after the depth pre-pass
+invariant gl_Position;
 
-uniform mat4 projection;
-uniform mat4 view;
-uniform mat4 model;
+#include "common/draws.glsl"
+
+#include "common/frame.glsl"
 
 void main()
 {
+    DrawData draw = draws[gl_BaseInstance + gl_InstanceID];
+    mat4 model = draw.model;
+    MaterialIndex = draw.material.x;
+
     TexCoords = aTexCoords;
     WorldPos = vec3(model * vec4(aPos, 1.0));
     Normal = mat3(model) * aNormal;   
 
     gl_Position =  projection * view * vec4(WorldPos, 1.0);
-}
\ No newline at end of file
+}
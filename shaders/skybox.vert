@@ -1,8 +1,7 @@
 #version 460 core
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 projection;
-uniform mat4 view;
+#include "common/frame.glsl"
 
 out vec3 localPos;
 
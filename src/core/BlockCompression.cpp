@@ -0,0 +1,514 @@
+#include "BlockCompression.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "Parallel.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BLOCK_COMPRESSION_SSE 1
+#endif
+
+namespace {
+	const uint32_t kMagic = 0x58455442; // "BTEX"
+	const uint32_t kVersion = 1;
+
+	struct FileHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t internal_format;
+		uint32_t width;
+		uint32_t height;
+		uint32_t mip_count;
+	};
+	// GL 4.6 guarantees at least this GL_MAX_TEXTURE_SIZE, the reader runs without a context to query it
+	const uint32_t kMaxTextureSize = 16384;
+
+	// BC7 4 bit index interpolation weights, out of 64
+	const int kWeights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// Writes LSB first, the block must start zeroed
+	struct BitWriter {
+		unsigned char* data;
+		unsigned int position = 0;
+
+		void Write(uint32_t value, unsigned int bits)
+		{
+			for (unsigned int i = 0; i < bits; ++i, ++position) {
+				data[position >> 3] |= static_cast<unsigned char>(((value >> i) & 1u) << (position & 7));
+			}
+		}
+	};
+
+	// Nearest palette entry for each of the 16 texels (RGBA stored as SoA), returns the summed squared error
+	float FindIndices(const float texels[4][16], const float palette[16][4], unsigned int indices[16])
+	{
+#if BLOCK_COMPRESSION_SSE
+		__m128 total = _mm_setzero_ps();
+		for (int i = 0; i < 16; i += 4) {
+			__m128 r = _mm_loadu_ps(&texels[0][i]);
+			__m128 g = _mm_loadu_ps(&texels[1][i]);
+			__m128 b = _mm_loadu_ps(&texels[2][i]);
+			__m128 a = _mm_loadu_ps(&texels[3][i]);
+			__m128 best_error = _mm_set1_ps(1e30f);
+			__m128i best_index = _mm_setzero_si128();
+			for (int k = 0; k < 16; ++k) {
+				__m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[k][0]));
+				__m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[k][1]));
+				__m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[k][2]));
+				__m128 da = _mm_sub_ps(a, _mm_set1_ps(palette[k][3]));
+				__m128 error = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_add_ps(_mm_mul_ps(db, db), _mm_mul_ps(da, da)));
+				__m128i closer = _mm_castps_si128(_mm_cmplt_ps(error, best_error));
+				best_error = _mm_min_ps(error, best_error);
+				best_index = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(k)), _mm_andnot_si128(closer, best_index));
+			}
+			total = _mm_add_ps(total, best_error);
+
+			alignas(16) int lanes[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(lanes), best_index);
+			for (int lane = 0; lane < 4; ++lane) {
+				indices[i + lane] = lanes[lane];
+			}
+		}
+		alignas(16) float sums[4];
+		_mm_store_ps(sums, total);
+		return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+		float total = 0.0f;
+		for (int i = 0; i < 16; ++i) {
+			float best_error = 1e30f;
+			for (int k = 0; k < 16; ++k) {
+				float error = 0.0f;
+				for (int c = 0; c < 4; ++c) {
+					float d = texels[c][i] - palette[k][c];
+					error += d * d;
+				}
+				if (error < best_error) {
+					best_error = error;
+					indices[i] = k;
+				}
+			}
+			total += best_error;
+		}
+		return total;
+#endif
+	}
+
+	// Least squares endpoints for fixed indices, false if all texels use the same weight
+	bool FitEndpoints(const float texels[4][16], const unsigned int indices[16], float e0[4], float e1[4])
+	{
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		float rhs0[4] = {}, rhs1[4] = {};
+		for (int i = 0; i < 16; ++i) {
+			float w = kWeights4[indices[i]] / 64.0f;
+			aa += (1.0f - w) * (1.0f - w);
+			ab += (1.0f - w) * w;
+			bb += w * w;
+			for (int c = 0; c < 4; ++c) {
+				rhs0[c] += (1.0f - w) * texels[c][i];
+				rhs1[c] += w * texels[c][i];
+			}
+		}
+
+		float det = aa * bb - ab * ab;
+		if (std::fabs(det) < 1e-6f) {
+			return false;
+		}
+		for (int c = 0; c < 4; ++c) {
+			e0[c] = std::min(std::max((bb * rhs0[c] - ab * rhs1[c]) / det, 0.0f), 255.0f);
+			e1[c] = std::min(std::max((aa * rhs1[c] - ab * rhs0[c]) / det, 0.0f), 255.0f);
+		}
+		return true;
+	}
+
+	unsigned int ChannelsRead(BlockCompression::Format format)
+	{
+		switch (format)
+		{
+		case BlockCompression::Format::BC4: return 1;
+		case BlockCompression::Format::BC5: return 2;
+		default: return 4;
+		}
+	}
+}
+
+unsigned int BlockCompression::InternalFormat(Format format)
+{
+	switch (format)
+	{
+	case Format::BC4: return GL_COMPRESSED_RED_RGTC1;
+	case Format::BC5: return GL_COMPRESSED_RG_RGTC2;
+	default: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	}
+}
+
+unsigned int BlockCompression::BlockBytes(Format format)
+{
+	return format == Format::BC4 ? 8 : 16;
+}
+
+BlockCompression::Image BlockCompression::PackOrm(Channel occlusion, Channel roughness, Channel metallic)
+{
+	const Channel sources[3] = { occlusion, roughness, metallic };
+	const unsigned char defaults[3] = { 255, 255, 0 };
+
+	Image packed;
+	for (const Channel& source : sources) {
+		if (!source.image) {
+			continue;
+		}
+		if (packed.width == 0) {
+			packed.width = source.image->width;
+			packed.height = source.image->height;
+		}
+		else if (source.image->width != packed.width || source.image->height != packed.height) {
+			std::cout << "ERROR::BLOCK_COMPRESSION::ORM_SIZE_MISMATCH" << std::endl;
+			return Image();
+		}
+	}
+
+	packed.channels = 3;
+	size_t texels = static_cast<size_t>(packed.width) * packed.height;
+	packed.pixels.resize(texels * 3);
+	for (int c = 0; c < 3; ++c) {
+		const Image* source = sources[c].image;
+		if (!source) {
+			unsigned char neutral = sources[c].neutral < 0 ? defaults[c] : static_cast<unsigned char>(std::min(sources[c].neutral, 255));
+			for (size_t i = 0; i < texels; ++i) {
+				packed.pixels[i * 3 + c] = neutral;
+			}
+			continue;
+		}
+		unsigned int index = std::min(sources[c].index, source->channels - 1);
+		for (size_t i = 0; i < texels; ++i) {
+			packed.pixels[i * 3 + c] = source->pixels[i * source->channels + index];
+		}
+	}
+	return packed;
+}
+
+std::vector<BlockCompression::Image> BlockCompression::GenerateMipChain(Image image)
+{
+	std::vector<Image> mips;
+	mips.push_back(std::move(image));
+
+	// 2x2 box filter down to 1x1, odd edges repeat their last row/column
+	while (mips.back().width > 1 || mips.back().height > 1) {
+		const Image& src = mips.back();
+		unsigned int channels = src.channels;
+		Image dst;
+		dst.width = std::max(1u, src.width / 2);
+		dst.height = std::max(1u, src.height / 2);
+		dst.channels = channels;
+		dst.pixels.resize(static_cast<size_t>(dst.width) * dst.height * channels);
+
+		for (unsigned int y = 0; y < dst.height; ++y) {
+			unsigned int y0 = std::min(y * 2, src.height - 1);
+			unsigned int y1 = std::min(y * 2 + 1, src.height - 1);
+			for (unsigned int x = 0; x < dst.width; ++x) {
+				unsigned int x0 = std::min(x * 2, src.width - 1);
+				unsigned int x1 = std::min(x * 2 + 1, src.width - 1);
+				for (unsigned int c = 0; c < channels; ++c) {
+					unsigned int sum = src.pixels[(static_cast<size_t>(y0) * src.width + x0) * channels + c]
+						+ src.pixels[(static_cast<size_t>(y0) * src.width + x1) * channels + c]
+						+ src.pixels[(static_cast<size_t>(y1) * src.width + x0) * channels + c]
+						+ src.pixels[(static_cast<size_t>(y1) * src.width + x1) * channels + c];
+					dst.pixels[(static_cast<size_t>(y) * dst.width + x) * channels + c] = static_cast<unsigned char>((sum + 2) / 4);
+				}
+			}
+		}
+		mips.push_back(std::move(dst));
+	}
+	return mips;
+}
+
+void BlockCompression::EncodeBC4Block(const unsigned char texels[16], unsigned char block[8])
+{
+	unsigned char lo = 255, hi = 0;
+	for (int i = 0; i < 16; ++i) {
+		lo = std::min(lo, texels[i]);
+		hi = std::max(hi, texels[i]);
+	}
+
+	// red_0 > red_1 selects the 8 value palette: index 0 is red_0, 1 is red_1 and 2-7 step from red_0 to red_1
+	std::memset(block, 0, 8);
+	block[0] = hi;
+	block[1] = lo;
+	if (hi == lo) {
+		return;
+	}
+
+	// Position of each texel along hi -> lo in sevenths
+	unsigned int steps[16];
+	float scale = 7.0f / (hi - lo);
+#if BLOCK_COMPRESSION_SSE
+	for (int i = 0; i < 16; i += 4) {
+		__m128 value = _mm_setr_ps(texels[i], texels[i + 1], texels[i + 2], texels[i + 3]);
+		__m128i step = _mm_cvtps_epi32(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(hi), value), _mm_set1_ps(scale)));
+		alignas(16) int lanes[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(lanes), step);
+		for (int lane = 0; lane < 4; ++lane) {
+			steps[i + lane] = lanes[lane];
+		}
+	}
+#else
+	for (int i = 0; i < 16; ++i) {
+		steps[i] = static_cast<unsigned int>(std::lround((hi - texels[i]) * scale));
+	}
+#endif
+
+	uint64_t bits = 0;
+	for (int i = 0; i < 16; ++i) {
+		unsigned int step = std::min(steps[i], 7u);
+		uint64_t index = step == 0 ? 0 : (step == 7 ? 1 : step + 1);
+		bits |= index << (3 * i);
+	}
+	for (int i = 0; i < 6; ++i) {
+		block[2 + i] = static_cast<unsigned char>(bits >> (8 * i));
+	}
+}
+
+void BlockCompression::EncodeBC5Block(const unsigned char texels[32], unsigned char block[16])
+{
+	unsigned char red[16], green[16];
+	for (int i = 0; i < 16; ++i) {
+		red[i] = texels[i * 2];
+		green[i] = texels[i * 2 + 1];
+	}
+	EncodeBC4Block(red, block);
+	EncodeBC4Block(green, block + 8);
+}
+
+void BlockCompression::EncodeBC7Block(const unsigned char texels[64], unsigned char block[16])
+{
+	float soa[4][16];
+	float mean[4] = {};
+	for (int i = 0; i < 16; ++i) {
+		for (int c = 0; c < 4; ++c) {
+			soa[c][i] = texels[i * 4 + c];
+			mean[c] += soa[c][i] / 16.0f;
+		}
+	}
+
+	// Principal axis of the block colors by power iteration on the covariance matrix
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; ++i) {
+		for (int r = 0; r < 4; ++r) {
+			for (int c = 0; c < 4; ++c) {
+				covariance[r][c] += (soa[r][i] - mean[r]) * (soa[c][i] - mean[c]);
+			}
+		}
+	}
+	float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; ++iteration) {
+		float next[4] = {};
+		for (int r = 0; r < 4; ++r) {
+			for (int c = 0; c < 4; ++c) {
+				next[r] += covariance[r][c] * axis[c];
+			}
+		}
+		float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+		if (length < 1e-6f) {
+			break;
+		}
+		for (int c = 0; c < 4; ++c) {
+			axis[c] = next[c] / length;
+		}
+	}
+
+	float t_min = 0.0f, t_max = 0.0f;
+	for (int i = 0; i < 16; ++i) {
+		float t = 0.0f;
+		for (int c = 0; c < 4; ++c) {
+			t += (soa[c][i] - mean[c]) * axis[c];
+		}
+		t_min = std::min(t_min, t);
+		t_max = std::max(t_max, t);
+	}
+	float e0[4], e1[4];
+	for (int c = 0; c < 4; ++c) {
+		e0[c] = std::min(std::max(mean[c] + axis[c] * t_min, 0.0f), 255.0f);
+		e1[c] = std::min(std::max(mean[c] + axis[c] * t_max, 0.0f), 255.0f);
+	}
+
+	// Try all p-bit pairs on the PCA endpoints, then once more on the least squares fit of the best indices
+	float best_error = 1e30f;
+	unsigned int best_q0[4] = {}, best_q1[4] = {}, best_p0 = 0, best_p1 = 0;
+	unsigned int best_indices[16] = {};
+	for (int pass = 0; pass < 2; ++pass) {
+		for (unsigned int p0 = 0; p0 < 2; ++p0) {
+			for (unsigned int p1 = 0; p1 < 2; ++p1) {
+				unsigned int q0[4], q1[4];
+				float palette[16][4];
+				for (int c = 0; c < 4; ++c) {
+					q0[c] = static_cast<unsigned int>(std::min(std::max(std::lround((e0[c] - p0) * 0.5f), 0l), 127l));
+					q1[c] = static_cast<unsigned int>(std::min(std::max(std::lround((e1[c] - p1) * 0.5f), 0l), 127l));
+					int end0 = static_cast<int>(q0[c] * 2 + p0);
+					int end1 = static_cast<int>(q1[c] * 2 + p1);
+					for (int k = 0; k < 16; ++k) {
+						palette[k][c] = static_cast<float>(((64 - kWeights4[k]) * end0 + kWeights4[k] * end1 + 32) >> 6);
+					}
+				}
+
+				unsigned int indices[16];
+				float error = FindIndices(soa, palette, indices);
+				if (error < best_error) {
+					best_error = error;
+					std::memcpy(best_q0, q0, sizeof(q0));
+					std::memcpy(best_q1, q1, sizeof(q1));
+					std::memcpy(best_indices, indices, sizeof(indices));
+					best_p0 = p0;
+					best_p1 = p1;
+				}
+			}
+		}
+		if (pass == 0 && (best_error == 0.0f || !FitEndpoints(soa, best_indices, e0, e1))) {
+			break;
+		}
+	}
+
+	// The anchor texel stores only 3 index bits, so its index must be below 8
+	if (best_indices[0] & 8) {
+		std::swap(best_q0, best_q1);
+		std::swap(best_p0, best_p1);
+		for (unsigned int& index : best_indices) {
+			index = 15 - index;
+		}
+	}
+
+	std::memset(block, 0, 16);
+	BitWriter writer{ block };
+	writer.Write(1u << 6, 7); // mode 6
+	for (int c = 0; c < 4; ++c) {
+		writer.Write(best_q0[c], 7);
+		writer.Write(best_q1[c], 7);
+	}
+	writer.Write(best_p0, 1);
+	writer.Write(best_p1, 1);
+	writer.Write(best_indices[0], 3);
+	for (int i = 1; i < 16; ++i) {
+		writer.Write(best_indices[i], 4);
+	}
+}
+
+std::vector<unsigned char> BlockCompression::Encode(Format format, const Image& image)
+{
+	unsigned int blocks_x = (image.width + 3) / 4;
+	unsigned int blocks_y = (image.height + 3) / 4;
+	unsigned int block_bytes = BlockBytes(format);
+	unsigned int channels = ChannelsRead(format);
+	std::vector<unsigned char> blocks(static_cast<size_t>(blocks_x) * blocks_y * block_bytes);
+
+	Parallel::For(0, blocks_y, [&](size_t by) {
+		unsigned char texels[64];
+		for (unsigned int bx = 0; bx < blocks_x; ++bx) {
+			for (unsigned int y = 0; y < 4; ++y) {
+				unsigned int sy = std::min(static_cast<unsigned int>(by) * 4 + y, image.height - 1);
+				for (unsigned int x = 0; x < 4; ++x) {
+					unsigned int sx = std::min(bx * 4 + x, image.width - 1);
+					const unsigned char* texel = &image.pixels[(static_cast<size_t>(sy) * image.width + sx) * image.channels];
+					unsigned char* out = &texels[(y * 4 + x) * channels];
+					for (unsigned int c = 0; c < channels; ++c) {
+						if (c < image.channels) {
+							out[c] = texel[c];
+						}
+						else if (c == 3) {
+							out[c] = 255;
+						}
+						else {
+							out[c] = image.channels == 1 ? texel[0] : 0;
+						}
+					}
+				}
+			}
+
+			unsigned char* block = &blocks[(by * blocks_x + bx) * block_bytes];
+			switch (format)
+			{
+			case Format::BC4: EncodeBC4Block(texels, block); break;
+			case Format::BC5: EncodeBC5Block(texels, block); break;
+			default: EncodeBC7Block(texels, block); break;
+			}
+		}
+	});
+
+	return blocks;
+}
+
+bool BlockCompression::WriteContainer(const std::string& path, const CompressedImage& image)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file) {
+		std::cout << "ERROR::BLOCK_COMPRESSION::FAILED_TO_OPEN " << path << std::endl;
+		return false;
+	}
+
+	FileHeader header{ kMagic, kVersion, image.internal_format, image.width, image.height, static_cast<uint32_t>(image.mips.size()) };
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	for (const std::vector<unsigned char>& mip : image.mips) {
+		uint32_t size = static_cast<uint32_t>(mip.size());
+		file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+		file.write(reinterpret_cast<const char*>(mip.data()), size);
+	}
+	return static_cast<bool>(file);
+}
+
+bool BlockCompression::ReadContainer(const std::string& path, CompressedImage& image)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	FileHeader header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	unsigned int block_bytes = 0;
+	for (Format format : { Format::BC4, Format::BC5, Format::BC7 }) {
+		if (header.internal_format == InternalFormat(format)) {
+			block_bytes = BlockBytes(format);
+		}
+	}
+	// Sizes are checked before anything is allocated, a corrupt header must not reach the GL upload
+	uint32_t max_mips = 0;
+	for (uint32_t size = std::max(header.width, header.height); size > 0; size >>= 1) {
+		max_mips++;
+	}
+	if (!file || header.magic != kMagic || header.version != kVersion || block_bytes == 0 || header.width == 0 || header.height == 0 ||
+		header.width > kMaxTextureSize || header.height > kMaxTextureSize || header.mip_count == 0 || header.mip_count > max_mips) {
+		std::cout << "ERROR::BLOCK_COMPRESSION::INVALID_CONTAINER " << path << std::endl;
+		image = CompressedImage();
+		return false;
+	}
+
+	image.internal_format = header.internal_format;
+	image.width = header.width;
+	image.height = header.height;
+	image.mips.resize(header.mip_count);
+	for (uint32_t level = 0; level < header.mip_count; ++level) {
+		uint32_t width = std::max(1u, header.width >> level);
+		uint32_t height = std::max(1u, header.height >> level);
+		uint32_t expected = ((width + 3) / 4) * ((height + 3) / 4) * block_bytes;
+		uint32_t size = 0;
+		file.read(reinterpret_cast<char*>(&size), sizeof(size));
+		if (file && size != expected) {
+			std::cout << "ERROR::BLOCK_COMPRESSION::INVALID_CONTAINER " << path << std::endl;
+			image = CompressedImage();
+			return false;
+		}
+		std::vector<unsigned char>& mip = image.mips[level];
+		mip.resize(size);
+		file.read(reinterpret_cast<char*>(mip.data()), size);
+		if (!file) {
+			std::cout << "ERROR::BLOCK_COMPRESSION::TRUNCATED_CONTAINER " << path << std::endl;
+			image = CompressedImage();
+			return false;
+		}
+	}
+	return true;
+}
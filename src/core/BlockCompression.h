@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// CPU encoders for the BCn formats the material maps use, and the .btex container they are stored in.
+// BC4 holds one channel (metallic, roughness, AO), BC5 two (normal map XY, Z is rebuilt in pbr.frag) and
+// BC7 RGBA (albedo). Only BC7 mode 6 is used: one subset with 7.7.7.7.1 endpoints and 4 bit indices is a
+// good fit for smooth material maps and keeps the encoder simple enough to run offline on large libraries.
+// GL-free, formats are stored as the GL_COMPRESSED_* enums.
+namespace BlockCompression {
+	enum class Format {
+		BC4,
+		BC5,
+		BC7,
+	};
+
+	// 8 bit image with 1-4 interleaved channels, rows in upload order
+	struct Image {
+		unsigned int width = 0;
+		unsigned int height = 0;
+		unsigned int channels = 0;
+		std::vector<unsigned char> pixels;
+	};
+
+	// Compressed mip chain as written by tools/TextureCompress
+	struct CompressedImage {
+		unsigned int internal_format = 0;
+		unsigned int width = 0;
+		unsigned int height = 0;
+		std::vector<std::vector<unsigned char>> mips;
+	};
+
+	unsigned int InternalFormat(Format format);
+	unsigned int BlockBytes(Format format);
+
+	// One channel of an image, `image` is null for a missing map
+	struct Channel {
+		const Image* image = nullptr;
+		unsigned int index = 0;
+		// Value of a missing map, negative for PackOrm's default
+		int neutral = -1;
+	};
+
+	// Packs one channel of each map into one RGB image: R occlusion, G roughness, B metallic.
+	// A missing map is filled with its channel's neutral value, by default no occlusion, fully rough and
+	// dielectric. glTF multiplies its factors with the maps, so it passes 1 (255) for all three instead.
+	// All given maps must have the same size, an empty image is returned otherwise.
+	Image PackOrm(Channel occlusion, Channel roughness, Channel metallic);
+
+	// Box filtered chain down to 1x1, the first entry is the image itself
+	std::vector<Image> GenerateMipChain(Image image);
+
+	// Single 4x4 blocks, texels in row-major order
+	void EncodeBC4Block(const unsigned char texels[16], unsigned char block[8]);
+	void EncodeBC5Block(const unsigned char texels[32], unsigned char block[16]);
+	void EncodeBC7Block(const unsigned char texels[64], unsigned char block[16]);
+
+	// Encodes every block of the image on all hardware threads. BC4 reads the first channel, BC5 the first two
+	// and BC7 expands grey/RGB to RGBA. Partial blocks at the edges repeat the last row/column.
+	std::vector<unsigned char> Encode(Format format, const Image& image);
+
+	bool WriteContainer(const std::string& path, const CompressedImage& image);
+	// Fails for anything but a BC4/BC5/BC7 chain whose level sizes match its dimensions
+	bool ReadContainer(const std::string& path, CompressedImage& image);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <limits>
+
+#include <glm/glm.hpp>
+
+// Axis aligned bounding box, in the space of whatever it bounds
+struct Aabb {
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 max = glm::vec3(0.0f);
+
+	// Inverted so that growing it by anything gives that
+	static Aabb Empty()
+	{
+		Aabb empty;
+		empty.min = glm::vec3(std::numeric_limits<float>::max());
+		empty.max = glm::vec3(-std::numeric_limits<float>::max());
+		return empty;
+	}
+
+	glm::vec3 Center() const { return (min + max) * 0.5f; }
+	glm::vec3 Extents() const { return (max - min) * 0.5f; }
+	// Half the surface area, all the surface area heuristic needs. 0 for an empty box.
+	float HalfArea() const
+	{
+		glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+
+	void Grow(const glm::vec3& point)
+	{
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+	void Grow(const Aabb& other)
+	{
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+
+	// Box around the transformed box: the extents go through the absolute 3x3 part (Arvo)
+	Aabb Transformed(const glm::mat4& transform) const
+	{
+		glm::vec3 center = glm::vec3(transform * glm::vec4(Center(), 1.0f));
+		glm::mat3 absolute = glm::mat3(glm::abs(glm::vec3(transform[0])), glm::abs(glm::vec3(transform[1])), glm::abs(glm::vec3(transform[2])));
+		glm::vec3 extents = absolute * Extents();
+		Aabb result;
+		result.min = center - extents;
+		result.max = center + extents;
+		return result;
+	}
+};
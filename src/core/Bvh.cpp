@@ -0,0 +1,415 @@
+#include "Bvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <numeric>
+#include <sstream>
+#include <thread>
+
+#include "Parallel.h"
+
+namespace {
+	// Cost of visiting a node relative to testing one object
+	const float kTraversalCost = 1.0f;
+
+	// Distance at which the ray enters the box, clamped to 0 from inside, or infinity if it misses
+	float RayEntry(const glm::vec3& min, const glm::vec3& max, const glm::vec3& origin, const glm::vec3& inverse_direction)
+	{
+		glm::vec3 t0 = (min - origin) * inverse_direction;
+		glm::vec3 t1 = (max - origin) * inverse_direction;
+		glm::vec3 near_t = glm::min(t0, t1);
+		glm::vec3 far_t = glm::max(t0, t1);
+		float entry = std::max(std::max(near_t.x, near_t.y), std::max(near_t.z, 0.0f));
+		float exit = std::min(std::min(far_t.x, far_t.y), far_t.z);
+		return entry <= exit ? entry : std::numeric_limits<float>::infinity();
+	}
+
+	// -1 completely outside one plane, 1 inside all of them, 0 crossing
+	int Classify(const Frustum& frustum, const glm::vec3& min, const glm::vec3& max)
+	{
+		glm::vec3 center = (min + max) * 0.5f;
+		glm::vec3 extents = (max - min) * 0.5f;
+		int result = 1;
+		for (const glm::vec4& plane : frustum.planes) {
+			float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+			float radius = glm::dot(glm::abs(glm::vec3(plane)), extents);
+			if (distance + radius < 0.0f) {
+				return -1;
+			}
+			if (distance - radius < 0.0f) {
+				result = 0;
+			}
+		}
+		return result;
+	}
+}
+
+struct Bvh::BuildRef {
+	Aabb bounds;
+	glm::vec3 centroid;
+	unsigned int object;
+};
+
+void Bvh::Build(const std::vector<Aabb>& bounds)
+{
+	auto start = std::chrono::steady_clock::now();
+	Clear();
+	if (bounds.empty()) {
+		return;
+	}
+
+	unsigned int count = static_cast<unsigned int>(bounds.size());
+	std::vector<BuildRef> refs(count);
+	auto reference = [&](size_t object) {
+		refs[object].bounds = bounds[object];
+		refs[object].centroid = bounds[object].Center();
+		refs[object].object = static_cast<unsigned int>(object);
+	};
+	if (count >= kParallelBuildSize) {
+		Parallel::For(0, count, reference, 4096);
+	}
+	else {
+		for (size_t object = 0; object < count; ++object) {
+			reference(object);
+		}
+	}
+
+	// One thread per subtree from the level where there are as many subtrees as hardware threads
+	unsigned int parallel_depth = 0;
+	while ((1u << parallel_depth) < Parallel::ThreadCount()) {
+		parallel_depth++;
+	}
+	nodes_.reserve(2 * count / kMaxLeafSize + 1);
+	BuildRange(refs, 0, count, parallel_depth, nodes_);
+
+	objects_.resize(count);
+	positions_.resize(count);
+	bounds_.resize(count);
+	for (unsigned int position = 0; position < count; ++position) {
+		objects_[position] = refs[position].object;
+		positions_[refs[position].object] = position;
+		bounds_[position] = refs[position].bounds;
+	}
+
+	// Parents come before their children, so one forward pass links them up
+	parents_.assign(nodes_.size(), 0);
+	leaves_.resize(count);
+	std::vector<unsigned int> depths(nodes_.size(), 1);
+	for (unsigned int node = 0; node < nodes_.size(); ++node) {
+		const Node& entry = nodes_[node];
+		depth_ = std::max(depth_, depths[node]);
+		if (entry.count > 0) {
+			for (unsigned int position = entry.offset; position < entry.offset + entry.count; ++position) {
+				leaves_[position] = node;
+			}
+		}
+		else {
+			parents_[node + 1] = parents_[entry.offset] = node;
+			depths[node + 1] = depths[entry.offset] = depths[node] + 1;
+		}
+	}
+
+	build_milliseconds_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Bvh::Clear()
+{
+	nodes_.clear();
+	objects_.clear();
+	positions_.clear();
+	bounds_.clear();
+	parents_.clear();
+	leaves_.clear();
+	dirty_.clear();
+	depth_ = 0;
+	build_milliseconds_ = 0.0;
+}
+
+size_t Bvh::ObjectCount() const
+{
+	return objects_.size();
+}
+
+void Bvh::Update(unsigned int object, const Aabb& bounds)
+{
+	bounds_[positions_[object]] = bounds;
+	dirty_.push_back(object);
+}
+
+void Bvh::Refit()
+{
+	if (dirty_.empty()) {
+		return;
+	}
+
+	// Children have higher indices than their parents, going backwards fits every node after its children
+	if (dirty_.size() * 4 >= nodes_.size()) {
+		for (size_t node = nodes_.size(); node-- > 0;) {
+			FitNode(static_cast<unsigned int>(node));
+		}
+	}
+	else {
+		// Walk up from each moved object until a box stays the same, the ones above it can't change either
+		for (unsigned int object : dirty_) {
+			unsigned int node = leaves_[positions_[object]];
+			for (;;) {
+				Node before = nodes_[node];
+				FitNode(node);
+				if ((before.min == nodes_[node].min && before.max == nodes_[node].max) || node == 0) {
+					break;
+				}
+				node = parents_[node];
+			}
+		}
+	}
+	dirty_.clear();
+}
+
+void Bvh::Query(const Frustum& frustum, std::vector<unsigned int>& objects) const
+{
+	if (nodes_.empty()) {
+		return;
+	}
+
+	// Below a node that is inside every plane nothing needs testing
+	struct Entry {
+		unsigned int node;
+		bool inside;
+	};
+	std::vector<Entry> stack;
+	stack.reserve(depth_ + 1);
+	stack.push_back({ 0, false });
+	while (!stack.empty()) {
+		Entry entry = stack.back();
+		stack.pop_back();
+		const Node& node = nodes_[entry.node];
+		bool inside = entry.inside;
+		if (!inside) {
+			int side = Classify(frustum, node.min, node.max);
+			if (side < 0) {
+				continue;
+			}
+			inside = side > 0;
+		}
+
+		if (node.count > 0) {
+			for (unsigned int position = node.offset; position < node.offset + node.count; ++position) {
+				if (inside || Classify(frustum, bounds_[position].min, bounds_[position].max) >= 0) {
+					objects.push_back(objects_[position]);
+				}
+			}
+		}
+		else {
+			stack.push_back({ node.offset, inside });
+			stack.push_back({ entry.node + 1, inside });
+		}
+	}
+}
+
+bool Bvh::Raycast(const glm::vec3& origin, const glm::vec3& direction, float max_distance, RayHit& hit) const
+{
+	if (nodes_.empty()) {
+		return false;
+	}
+
+	// Division by a zero component gives an infinity, which the slab test handles
+	glm::vec3 inverse_direction = 1.0f / direction;
+	float nearest = max_distance;
+	bool found = false;
+
+	struct Entry {
+		unsigned int node;
+		float entry;
+	};
+	std::vector<Entry> stack;
+	stack.reserve(depth_ + 1);
+	float root_entry = RayEntry(nodes_[0].min, nodes_[0].max, origin, inverse_direction);
+	if (root_entry <= nearest) {
+		stack.push_back({ 0, root_entry });
+	}
+	while (!stack.empty()) {
+		Entry entry = stack.back();
+		stack.pop_back();
+		// A nearer hit may have been found since the node was pushed
+		if (entry.entry > nearest) {
+			continue;
+		}
+
+		const Node& node = nodes_[entry.node];
+		if (node.count > 0) {
+			for (unsigned int position = node.offset; position < node.offset + node.count; ++position) {
+				float distance = RayEntry(bounds_[position].min, bounds_[position].max, origin, inverse_direction);
+				if (distance <= nearest) {
+					nearest = distance;
+					hit.object = objects_[position];
+					hit.distance = distance;
+					found = true;
+				}
+			}
+			continue;
+		}
+
+		// The nearer child goes on top so it is visited first and shortens the ray for the other one
+		unsigned int first = entry.node + 1;
+		unsigned int second = node.offset;
+		float first_entry = RayEntry(nodes_[first].min, nodes_[first].max, origin, inverse_direction);
+		float second_entry = RayEntry(nodes_[second].min, nodes_[second].max, origin, inverse_direction);
+		if (second_entry < first_entry) {
+			std::swap(first, second);
+			std::swap(first_entry, second_entry);
+		}
+		if (second_entry <= nearest) {
+			stack.push_back({ second, second_entry });
+		}
+		if (first_entry <= nearest) {
+			stack.push_back({ first, first_entry });
+		}
+	}
+	return found;
+}
+
+std::string Bvh::Report() const
+{
+	std::ostringstream report;
+	report << "BVH: " << objects_.size() << " objects, " << nodes_.size() << " nodes, depth " << depth_
+		<< ", built in " << build_milliseconds_ << " ms";
+	return report.str();
+}
+
+void Bvh::BuildRange(std::vector<BuildRef>& refs, unsigned int first, unsigned int count, unsigned int parallel_depth,
+	std::vector<Node>& nodes)
+{
+	unsigned int index = static_cast<unsigned int>(nodes.size());
+	nodes.push_back(Node());
+
+	Aabb box = Aabb::Empty();
+	Aabb centroid_box = Aabb::Empty();
+	for (unsigned int position = first; position < first + count; ++position) {
+		box.Grow(refs[position].bounds);
+		centroid_box.Grow(refs[position].centroid);
+	}
+	nodes[index].min = box.min;
+	nodes[index].max = box.max;
+
+	// Binned SAH: objects go into kBins slabs by centroid along each axis, and the cost of splitting between
+	// two slabs is the area of each side times its object count. All three axes are binned in one pass over
+	// the objects.
+	int best_axis = -1;
+	unsigned int best_split = 0;
+	float best_cost = std::numeric_limits<float>::max();
+	glm::vec3 centroid_size = centroid_box.max - centroid_box.min;
+	glm::vec3 scale = glm::vec3(0.0f);
+	for (int axis = 0; axis < 3; ++axis) {
+		scale[axis] = centroid_size[axis] > 0.0f ? kBins / centroid_size[axis] : 0.0f;
+	}
+	auto bin_of = [&](const BuildRef& ref, int axis) {
+		return std::min(static_cast<unsigned int>((ref.centroid[axis] - centroid_box.min[axis]) * scale[axis]), kBins - 1);
+	};
+	if (count > 1) {
+		unsigned int bin_counts[3][kBins] = {};
+		Aabb bin_boxes[3][kBins];
+		for (Aabb* axis_boxes : bin_boxes) {
+			std::fill(axis_boxes, axis_boxes + kBins, Aabb::Empty());
+		}
+		for (unsigned int position = first; position < first + count; ++position) {
+			const BuildRef& ref = refs[position];
+			for (int axis = 0; axis < 3; ++axis) {
+				unsigned int bin = bin_of(ref, axis);
+				bin_counts[axis][bin]++;
+				bin_boxes[axis][bin].Grow(ref.bounds);
+			}
+		}
+
+		for (int axis = 0; axis < 3; ++axis) {
+			if (scale[axis] == 0.0f) {
+				continue;
+			}
+			// Left side costs by sweeping forward, then add the right sides sweeping back
+			float left_costs[kBins] = {};
+			Aabb left = Aabb::Empty();
+			unsigned int left_count = 0;
+			for (unsigned int split = 1; split < kBins; ++split) {
+				left.Grow(bin_boxes[axis][split - 1]);
+				left_count += bin_counts[axis][split - 1];
+				left_costs[split] = left_count > 0 ? left.HalfArea() * left_count : -1.0f;
+			}
+			Aabb right = Aabb::Empty();
+			unsigned int right_count = 0;
+			for (unsigned int split = kBins - 1; split > 0; --split) {
+				right.Grow(bin_boxes[axis][split]);
+				right_count += bin_counts[axis][split];
+				if (right_count == 0 || left_costs[split] < 0.0f) {
+					continue;
+				}
+				float cost = left_costs[split] + right.HalfArea() * right_count;
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_axis = axis;
+					best_split = split;
+				}
+			}
+		}
+	}
+
+	float area = box.HalfArea();
+	bool small = count <= kMaxLeafSize;
+	if (count == 1 || (small && (best_axis < 0 || area * count <= area * kTraversalCost + best_cost))) {
+		nodes[index].offset = first;
+		nodes[index].count = count;
+		return;
+	}
+
+	unsigned int middle;
+	if (best_axis >= 0) {
+		auto left_of_split = [&](const BuildRef& ref) { return bin_of(ref, best_axis) < best_split; };
+		middle = static_cast<unsigned int>(
+			std::partition(refs.begin() + first, refs.begin() + first + count, left_of_split) - refs.begin());
+	}
+	else {
+		// All centroids in one point, any split is as good as another
+		middle = first + count / 2;
+	}
+
+	if (parallel_depth > 0 && count >= kParallelBuildSize) {
+		// The second subtree goes into its own array on another thread, then after the first one. Its second
+		// child indices start from 0 and are moved by where it lands, leaf offsets are already global.
+		std::vector<Node> second_nodes;
+		std::thread second([&]() {
+			BuildRange(refs, middle, first + count - middle, parallel_depth - 1, second_nodes);
+		});
+		BuildRange(refs, first, middle - first, parallel_depth - 1, nodes);
+		second.join();
+		unsigned int base = static_cast<unsigned int>(nodes.size());
+		nodes[index].offset = base;
+		for (Node node : second_nodes) {
+			if (node.count == 0) {
+				node.offset += base;
+			}
+			nodes.push_back(node);
+		}
+	}
+	else {
+		BuildRange(refs, first, middle - first, parallel_depth, nodes);
+		nodes[index].offset = static_cast<unsigned int>(nodes.size());
+		BuildRange(refs, middle, first + count - middle, parallel_depth, nodes);
+	}
+	nodes[index].count = 0;
+}
+
+void Bvh::FitNode(unsigned int node)
+{
+	Node& entry = nodes_[node];
+	Aabb box = Aabb::Empty();
+	if (entry.count > 0) {
+		for (unsigned int position = entry.offset; position < entry.offset + entry.count; ++position) {
+			box.Grow(bounds_[position]);
+		}
+	}
+	else {
+		box.min = glm::min(nodes_[node + 1].min, nodes_[entry.offset].min);
+		box.max = glm::max(nodes_[node + 1].max, nodes_[entry.offset].max);
+	}
+	entry.min = box.min;
+	entry.max = box.max;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Bounds.h"
+#include "FrustumCuller.h"
+
+// Bounding volume hierarchy over object bounds for frustum and ray queries. Built top down with a binned
+// surface area heuristic; the subtrees below the first few splits are built on their own threads.
+// Nodes are flattened in depth-first order into 32 byte entries, the first child directly follows its
+// parent and only the second one needs an index, so a traversal mostly walks forward through memory.
+// The object bounds are stored in leaf order for the same reason.
+// Moving objects are handled by Update + Refit, which keeps the topology and only grows or shrinks the
+// boxes above them. That suits motion that keeps neighbours together; when objects are added or removed,
+// or move across the scene, build again.
+class Bvh
+{
+public:
+	struct RayHit {
+		unsigned int object = 0;
+		// Along the ray direction, in its units
+		float distance = 0.0f;
+	};
+
+	// Object indices are positions in `bounds`
+	void Build(const std::vector<Aabb>& bounds);
+	void Clear();
+	size_t ObjectCount() const;
+
+	// New bounds of a moved object, applied to the tree by the next Refit
+	void Update(unsigned int object, const Aabb& bounds);
+	void Refit();
+
+	// Appends the objects whose bounds intersect the frustum
+	void Query(const Frustum& frustum, std::vector<unsigned int>& objects) const;
+	// Nearest object whose bounds the ray enters within `max_distance`
+	bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float max_distance, RayHit& hit) const;
+
+	// Objects, nodes, depth and build time
+	std::string Report() const;
+
+private:
+	static const unsigned int kBins = 16;
+	static const unsigned int kMaxLeafSize = 8;
+	// Ranges below this are built on the calling thread
+	static const size_t kParallelBuildSize = 16 * 1024;
+
+	struct Node {
+		glm::vec3 min;
+		// Interior nodes: index of the second child, the first one is the next node. Leaves: first object in leaf order.
+		unsigned int offset;
+		glm::vec3 max;
+		// Objects of a leaf, 0 for interior nodes
+		unsigned int count;
+	};
+	static_assert(sizeof(Node) == 32, "Two nodes per cache line");
+
+	std::vector<Node> nodes_;
+	// Leaf order to object and back
+	std::vector<unsigned int> objects_;
+	std::vector<unsigned int> positions_;
+	// Object bounds in leaf order
+	std::vector<Aabb> bounds_;
+	// Only read by Refit
+	std::vector<unsigned int> parents_;
+	std::vector<unsigned int> leaves_;
+	std::vector<unsigned int> dirty_;
+
+	unsigned int depth_ = 0;
+	double build_milliseconds_ = 0.0;
+
+	// An object while building, the builder partitions these in place rather than indices into the bounds
+	struct BuildRef;
+	static void BuildRange(std::vector<BuildRef>& refs, unsigned int first, unsigned int count, unsigned int parallel_depth,
+		std::vector<Node>& nodes);
+	void FitNode(unsigned int node);
+};
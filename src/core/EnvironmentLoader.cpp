@@ -0,0 +1,332 @@
+#include "EnvironmentLoader.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../opengl/Shader.h"
+#include "Renderer.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+namespace {
+	// The SH projection only keeps the lowest frequencies, a small cube is plenty
+	const unsigned int kShCubemapSize = 128;
+}
+
+EnvironmentLoader::EnvironmentLoader(Shader& equirectangular_to_cubemap, Shader& irradiance_shader, Shader& prefilter_shader,
+	Shader& prefilter_compute_shader, Renderer& renderer, ThreadPool& pool)
+	: equirectangular_to_cubemap_(equirectangular_to_cubemap), irradiance_shader_(irradiance_shader), prefilter_shader_(prefilter_shader),
+	prefilter_compute_shader_(prefilter_compute_shader), renderer_(renderer), pool_(pool)
+{
+	// Color only, none of the capture passes depth test against anything
+	glGenFramebuffers(1, &capture_fbo_);
+
+	capture_projection_ = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
+	capture_views_[0] = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+	capture_views_[1] = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+	capture_views_[2] = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	capture_views_[3] = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f));
+	capture_views_[4] = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+	capture_views_[5] = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+}
+
+EnvironmentLoader::~EnvironmentLoader()
+{
+	if (decoding_.valid()) {
+		decoding_.wait();
+	}
+	if (storing_.valid()) {
+		storing_.wait();
+	}
+	Abandon();
+	glDeleteFramebuffers(1, &capture_fbo_);
+}
+
+void EnvironmentLoader::Request(const std::string& path, const Ibl::BakeSettings& settings)
+{
+	// Validated once here, so the bake, the cache key and the maps handed back all agree
+	Ibl::BakeSettings validated = settings.Validated();
+
+	// The worker can't be interrupted, remember the request and start it once the worker is done
+	if (decoding_.valid()) {
+		has_queued_ = true;
+		queued_path_ = path;
+		queued_settings_ = validated;
+		return;
+	}
+
+	Abandon();
+	Start(path, validated);
+}
+
+bool EnvironmentLoader::Busy() const
+{
+	return loading_;
+}
+
+void EnvironmentLoader::Start(const std::string& path, const Ibl::BakeSettings& settings)
+{
+	path_ = path;
+	settings_ = settings;
+	loading_ = true;
+	failed_ = false;
+	bake_ms_ = 0.0;
+	bake_frames_ = 0;
+
+	decoding_ = pool_.Submit([path, settings]() {
+		Decoded decoded;
+		decoded.key = IblCache::ComputeKey(path, settings);
+		if (decoded.key != 0 && IblCache::Load(decoded.key, decoded.textures) && decoded.textures.size() == 3) {
+			decoded.cache_hit = true;
+			return decoded;
+		}
+		decoded.textures.clear();
+
+		if (!IblBaker::LoadHDR(path, decoded.hdr)) {
+			return decoded;
+		}
+		if (settings.sh_irradiance) {
+			IblBaker::Cubemap cubemap = IblBaker::CubemapFromEquirectangular(decoded.hdr, std::min(settings.env_size, kShCubemapSize));
+			decoded.irradiance_sh = IblBaker::ProjectIrradianceSH(cubemap);
+		}
+		return decoded;
+	});
+}
+
+void EnvironmentLoader::Abandon()
+{
+	steps_.clear();
+	Ibl::DeleteMaps(pending_);
+	glDeleteTextures(1, &hdr_texture_);
+	hdr_texture_ = 0;
+	decoded_ = Decoded();
+}
+
+bool EnvironmentLoader::Update(double budget_ms, Ibl::EnvironmentMaps& maps, Ibl::BakeSettings& settings)
+{
+	if (!loading_) {
+		return false;
+	}
+
+	if (decoding_.valid()) {
+		if (decoding_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			return false;
+		}
+		decoded_ = decoding_.get();
+
+		if (has_queued_) {
+			has_queued_ = false;
+			Abandon();
+			Start(queued_path_, queued_settings_);
+			return false;
+		}
+
+		if (decoded_.cache_hit) {
+			std::cout << "IBL::CACHE_HIT " << path_ << " (" << IblCache::Report() << ")" << std::endl;
+			QueueUploadSteps();
+		}
+		else if (!decoded_.hdr.pixels.empty()) {
+			QueueBakeSteps();
+			QueueStoreStep();
+		}
+		else {
+			failed_ = true;
+		}
+	}
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	bake_frames_++;
+
+	auto start = std::chrono::steady_clock::now();
+	while (!steps_.empty() && !failed_) {
+		std::function<void()> step = std::move(steps_.front());
+		steps_.pop_front();
+		step();
+		// Wait for the GPU so the budget covers the actual bake work and not just the submission
+		glFinish();
+
+		double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (elapsed_ms >= budget_ms) {
+			break;
+		}
+	}
+	bake_ms_ += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+	if (failed_) {
+		std::cout << "ERROR::ENVIRONMENT_LOADER::FAILED_TO_LOAD " << path_ << std::endl;
+		Abandon();
+		loading_ = false;
+		return false;
+	}
+	if (!steps_.empty()) {
+		return false;
+	}
+
+	if (!decoded_.cache_hit) {
+		std::cout << "IBL::BAKE " << path_ << (settings_.backend == Ibl::Backend::Compute ? " compute " : " raster ")
+			<< bake_ms_ << " ms over " << bake_frames_ << " frames" << std::endl;
+		IblCache::RecordBake(bake_ms_);
+		std::cout << "IBL::CACHE_MISS " << path_ << " (" << IblCache::Report() << ")" << std::endl;
+	}
+
+	// Swap the complete set in, the old maps were in use until now
+	Ibl::DeleteMaps(maps);
+	maps = pending_;
+	settings = settings_;
+	pending_ = Ibl::EnvironmentMaps();
+	decoded_ = Decoded();
+	loading_ = false;
+
+	if (has_queued_) {
+		has_queued_ = false;
+		Start(queued_path_, queued_settings_);
+	}
+	return true;
+}
+
+bool EnvironmentLoader::Finish(Ibl::EnvironmentMaps& maps, Ibl::BakeSettings& settings)
+{
+	while (loading_) {
+		if (decoding_.valid()) {
+			decoding_.wait();
+		}
+		if (Update(std::numeric_limits<double>::infinity(), maps, settings)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void EnvironmentLoader::QueueUploadSteps()
+{
+	steps_.push_back([this]() {
+		pending_.env_cubemap = Ibl::UploadTexture(decoded_.textures[0]);
+		failed_ = pending_.env_cubemap == 0;
+	});
+
+	steps_.push_back([this]() {
+		const CachedTexture& irradiance = decoded_.textures[1];
+		if (settings_.sh_irradiance) {
+			if (irradiance.images.size() != 1 || irradiance.images[0].size() != sizeof(glm::vec3) * pending_.irradiance_sh.size()) {
+				failed_ = true;
+				return;
+			}
+			std::memcpy(pending_.irradiance_sh.data(), irradiance.images[0].data(), irradiance.images[0].size());
+		}
+		else {
+			pending_.irradiance_map = Ibl::UploadTexture(irradiance);
+			failed_ = pending_.irradiance_map == 0;
+		}
+	});
+
+	steps_.push_back([this]() {
+		pending_.prefilter_map = Ibl::UploadTexture(decoded_.textures[2]);
+		failed_ = pending_.prefilter_map == 0;
+	});
+}
+
+void EnvironmentLoader::QueueBakeSteps()
+{
+	// HDR equirectangular map to cubemap, one face per step
+	steps_.push_back([this]() {
+		const IblBaker::Image& hdr = decoded_.hdr;
+		hdr_texture_ = Ibl::UploadEquirectangular(hdr.pixels.data(), hdr.width, hdr.height);
+		decoded_.hdr = IblBaker::Image();
+
+		pending_.env_cubemap = Ibl::AllocateCubemap(settings_.env_size, 1, GL_RGB16F);
+		pending_.irradiance_sh = decoded_.irradiance_sh;
+	});
+	for (unsigned int face = 0; face < 6; ++face) {
+		steps_.push_back([this, face]() {
+			equirectangular_to_cubemap_.Bind();
+			equirectangular_to_cubemap_.SetInt("equirectangularMap", 0);
+			equirectangular_to_cubemap_.SetMat4f("projection", capture_projection_);
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, hdr_texture_);
+			Ibl::RenderCubemapFace(capture_fbo_, equirectangular_to_cubemap_, capture_views_[face], pending_.env_cubemap, face, 0, settings_.env_size, renderer_);
+		});
+	}
+	steps_.push_back([this]() {
+		glDeleteTextures(1, &hdr_texture_);
+		hdr_texture_ = 0;
+	});
+
+	// Irradiance cubemap, unless it was projected onto SH by the worker
+	if (!settings_.sh_irradiance) {
+		steps_.push_back([this]() {
+			pending_.irradiance_map = Ibl::AllocateCubemap(settings_.irradiance_size, 1, GL_RGB16F);
+		});
+		for (unsigned int face = 0; face < 6; ++face) {
+			steps_.push_back([this, face]() {
+				irradiance_shader_.Bind();
+				irradiance_shader_.SetInt("environmentMap", 0);
+				irradiance_shader_.SetMat4f("projection", capture_projection_);
+				glActiveTexture(GL_TEXTURE0);
+				glBindTexture(GL_TEXTURE_CUBE_MAP, pending_.env_cubemap);
+				Ibl::RenderCubemapFace(capture_fbo_, irradiance_shader_, capture_views_[face], pending_.irradiance_map, face, 0, settings_.irradiance_size, renderer_);
+			});
+		}
+	}
+
+	// Prefilter map, one mip per step on the compute backend and one face of a mip on the raster backend
+	if (settings_.backend == Ibl::Backend::Compute) {
+		steps_.push_back([this]() {
+			pending_.prefilter_map = Ibl::AllocateCubemap(settings_.prefilter_size, settings_.prefilter_mips, GL_RGBA16F);
+		});
+		for (unsigned int mip = 0; mip < settings_.prefilter_mips; ++mip) {
+			steps_.push_back([this, mip]() {
+				Ibl::DispatchPrefilterMip(prefilter_compute_shader_, pending_.env_cubemap, pending_.prefilter_map, mip, settings_);
+			});
+		}
+	}
+	else {
+		steps_.push_back([this]() {
+			pending_.prefilter_map = Ibl::AllocateCubemap(settings_.prefilter_size, settings_.prefilter_mips, GL_RGB16F);
+		});
+		for (unsigned int mip = 0; mip < settings_.prefilter_mips; ++mip) {
+			for (unsigned int face = 0; face < 6; ++face) {
+				steps_.push_back([this, mip, face]() {
+					prefilter_shader_.Bind();
+					prefilter_shader_.SetInt("environmentMap", 0);
+					prefilter_shader_.SetMat4f("projection", capture_projection_);
+					prefilter_shader_.SetInt("sampleCount", settings_.sample_count);
+					prefilter_shader_.SetFloat("resolution", static_cast<float>(settings_.env_size));
+					prefilter_shader_.SetFloat("roughness", Ibl::PrefilterRoughness(mip, settings_.prefilter_mips));
+					glActiveTexture(GL_TEXTURE0);
+					glBindTexture(GL_TEXTURE_CUBE_MAP, pending_.env_cubemap);
+					Ibl::RenderCubemapFace(capture_fbo_, prefilter_shader_, capture_views_[face], pending_.prefilter_map, face, mip, settings_.prefilter_size, renderer_);
+				});
+			}
+		}
+	}
+}
+
+void EnvironmentLoader::QueueStoreStep()
+{
+	// Only the readback needs the GL thread, the file is written in the background
+	steps_.push_back([this]() {
+		if (decoded_.key == 0) {
+			return;
+		}
+		if (storing_.valid()) {
+			storing_.wait();
+		}
+
+		std::string path = path_;
+		uint64_t key = decoded_.key;
+		std::vector<CachedTexture> textures = Ibl::ReadbackMaps(pending_, settings_);
+		storing_ = pool_.Submit([path, key, textures = std::move(textures)]() {
+			if (!IblCache::Store(key, textures)) {
+				std::cout << "ERROR::IBL_CACHE::FAILED_TO_STORE " << path << std::endl;
+			}
+		});
+	});
+}
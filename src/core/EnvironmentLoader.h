@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Ibl.h"
+#include "IblBaker.h"
+#include "IblCache.h"
+
+class Shader;
+class Renderer;
+class ThreadPool;
+
+// Switches environments without stalling the frame. The cache lookup, HDR decode and SH projection run on a
+// thread pool, the GL side of the bake is split into small steps (one cubemap face or prefilter mip each)
+// that Update() runs under a per-frame time budget. The renderer keeps the old maps until the new set is
+// complete and they are swapped in a single call.
+class EnvironmentLoader
+{
+public:
+	EnvironmentLoader(Shader& equirectangular_to_cubemap, Shader& irradiance_shader, Shader& prefilter_shader,
+		Shader& prefilter_compute_shader, Renderer& renderer, ThreadPool& pool);
+	~EnvironmentLoader();
+
+	// Starts loading `path` in the background. If a load is already running the new one replaces it once the worker is done.
+	void Request(const std::string& path, const Ibl::BakeSettings& settings);
+
+	// Runs pending GL steps on the calling (GL) thread until `budget_ms` is used up, at least one step is run per call.
+	// Returns true when a new set is ready: the old maps in `maps` are deleted and replaced and `settings` is updated.
+	bool Update(double budget_ms, Ibl::EnvironmentMaps& maps, Ibl::BakeSettings& settings);
+
+	// Blocks until the requested environment is ready, used for the first load where there is nothing to show yet
+	bool Finish(Ibl::EnvironmentMaps& maps, Ibl::BakeSettings& settings);
+
+	bool Busy() const;
+
+private:
+	// Result of the worker thread
+	struct Decoded {
+		uint64_t key = 0;
+		bool cache_hit = false;
+		std::vector<CachedTexture> textures;
+		IblBaker::Image hdr;
+		std::array<glm::vec3, 9> irradiance_sh{};
+	};
+
+	Shader& equirectangular_to_cubemap_;
+	Shader& irradiance_shader_;
+	Shader& prefilter_shader_;
+	Shader& prefilter_compute_shader_;
+	Renderer& renderer_;
+	ThreadPool& pool_;
+
+	unsigned int capture_fbo_ = 0;
+	glm::mat4 capture_projection_;
+	glm::mat4 capture_views_[6];
+
+	std::string path_;
+	Ibl::BakeSettings settings_;
+	std::future<Decoded> decoding_;
+	bool loading_ = false;
+
+	bool has_queued_ = false;
+	std::string queued_path_;
+	Ibl::BakeSettings queued_settings_;
+
+	// GL work of the current load and the maps it is building
+	Decoded decoded_;
+	std::deque<std::function<void()>> steps_;
+	Ibl::EnvironmentMaps pending_;
+	unsigned int hdr_texture_ = 0;
+	bool failed_ = false;
+	// GL time spent on the current load and the number of frames it was spread over
+	double bake_ms_ = 0.0;
+	unsigned int bake_frames_ = 0;
+
+	std::future<void> storing_;
+
+	void Start(const std::string& path, const Ibl::BakeSettings& settings);
+	void Abandon();
+	void QueueUploadSteps();
+	void QueueBakeSteps();
+	void QueueStoreStep();
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// The std140 `Frame` uniform block shared by every program that renders from the camera (pbr, skybox, deferred).
+// It is written once per frame into the StreamBuffer and stays bound to kFrameBinding for all draws.
+struct FrameData {
+	static const unsigned int kFrameBinding = 0;
+
+	glm::mat4 view;
+	glm::mat4 projection;
+	// Clip space back to world space, for positions rebuilt from depth
+	glm::mat4 inverse_view_projection;
+	// xyz, w unused (vec3 is padded to 16 bytes in std140 anyway)
+	glm::vec4 camera_position;
+	// Light grid of LightClusters: tiles x, y, depth slices and light count
+	glm::uvec4 cluster_size;
+	// Tile size in pixels, depth slice scale and bias
+	glm::vec4 cluster_params;
+};
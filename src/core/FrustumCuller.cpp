@@ -0,0 +1,203 @@
+#include "FrustumCuller.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Parallel.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FRUSTUM_CULLER_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRUSTUM_CULLER_SSE 1
+#endif
+
+Frustum Frustum::FromMatrix(const glm::mat4& view_projection)
+{
+	// glm is column major, row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i])
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; ++i) {
+		rows[i] = glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
+	}
+
+	// Left, right, bottom, top, near, far for OpenGL's -1..1 clip depth
+	Frustum frustum;
+	frustum.planes[0] = rows[3] + rows[0];
+	frustum.planes[1] = rows[3] - rows[0];
+	frustum.planes[2] = rows[3] + rows[1];
+	frustum.planes[3] = rows[3] - rows[1];
+	frustum.planes[4] = rows[3] + rows[2];
+	frustum.planes[5] = rows[3] - rows[2];
+	for (glm::vec4& plane : frustum.planes) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return frustum;
+}
+
+void FrustumCuller::Clear()
+{
+	center_x_.clear();
+	center_y_.clear();
+	center_z_.clear();
+	extent_x_.clear();
+	extent_y_.clear();
+	extent_z_.clear();
+	radius_.clear();
+	count_ = 0;
+	visible_count_ = 0;
+}
+
+size_t FrustumCuller::Add(const Aabb& bounds)
+{
+	// The arrays always hold whole groups, the padding entries are never read back
+	if (count_ == center_x_.size()) {
+		size_t size = count_ + kGroupSize;
+		center_x_.resize(size, 0.0f);
+		center_y_.resize(size, 0.0f);
+		center_z_.resize(size, 0.0f);
+		extent_x_.resize(size, 0.0f);
+		extent_y_.resize(size, 0.0f);
+		extent_z_.resize(size, 0.0f);
+		radius_.resize(size, 0.0f);
+	}
+
+	glm::vec3 center = bounds.Center();
+	glm::vec3 extents = bounds.Extents();
+	center_x_[count_] = center.x;
+	center_y_[count_] = center.y;
+	center_z_[count_] = center.z;
+	extent_x_[count_] = extents.x;
+	extent_y_[count_] = extents.y;
+	extent_z_[count_] = extents.z;
+	radius_[count_] = glm::length(extents);
+	return count_++;
+}
+
+size_t FrustumCuller::Size() const
+{
+	return count_;
+}
+
+void FrustumCuller::Cull(const Frustum& frustum)
+{
+	visible_.resize(center_x_.size());
+	size_t groups = center_x_.size() / kGroupSize;
+	if (count_ >= kParallelThreshold) {
+		Parallel::For(0, groups, [&](size_t group) { CullGroup(frustum, group * kGroupSize); }, kGroupsPerJob);
+	}
+	else {
+		for (size_t group = 0; group < groups; ++group) {
+			CullGroup(frustum, group * kGroupSize);
+		}
+	}
+	visible_count_ = static_cast<size_t>(std::count(visible_.begin(), visible_.begin() + count_, 1));
+}
+
+bool FrustumCuller::Visible(size_t index) const
+{
+	return visible_[index] != 0;
+}
+
+glm::vec3 FrustumCuller::Center(size_t index) const
+{
+	return glm::vec3(center_x_[index], center_y_[index], center_z_[index]);
+}
+
+size_t FrustumCuller::VisibleCount() const
+{
+	return visible_count_;
+}
+
+void FrustumCuller::CullGroup(const Frustum& frustum, size_t first)
+{
+	// A bound is out once it is fully behind any plane. The sphere decides unless it crosses a plane, only
+	// then is the tighter box tested: its projected radius on a plane is dot(|n|, extents).
+#if FRUSTUM_CULLER_AVX
+	__m256 cx = _mm256_loadu_ps(&center_x_[first]);
+	__m256 cy = _mm256_loadu_ps(&center_y_[first]);
+	__m256 cz = _mm256_loadu_ps(&center_z_[first]);
+	__m256 radius = _mm256_loadu_ps(&radius_[first]);
+	__m256 negative_radius = _mm256_sub_ps(_mm256_setzero_ps(), radius);
+	__m256 out = _mm256_setzero_ps();
+	__m256 crossing = _mm256_setzero_ps();
+	__m256 distances[6];
+	for (int p = 0; p < 6; ++p) {
+		const glm::vec4& plane = frustum.planes[p];
+		__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), cx), _mm256_mul_ps(_mm256_set1_ps(plane.y), cy)),
+			_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.z), cz), _mm256_set1_ps(plane.w)));
+		distances[p] = d;
+		out = _mm256_or_ps(out, _mm256_cmp_ps(d, negative_radius, _CMP_LT_OQ));
+		crossing = _mm256_or_ps(crossing, _mm256_cmp_ps(d, radius, _CMP_LT_OQ));
+	}
+	if (_mm256_movemask_ps(_mm256_andnot_ps(out, crossing)) != 0) {
+		__m256 ex = _mm256_loadu_ps(&extent_x_[first]);
+		__m256 ey = _mm256_loadu_ps(&extent_y_[first]);
+		__m256 ez = _mm256_loadu_ps(&extent_z_[first]);
+		for (int p = 0; p < 6; ++p) {
+			glm::vec3 normal = glm::abs(glm::vec3(frustum.planes[p]));
+			__m256 extent = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(normal.x), ex), _mm256_mul_ps(_mm256_set1_ps(normal.y), ey)),
+				_mm256_mul_ps(_mm256_set1_ps(normal.z), ez));
+			out = _mm256_or_ps(out, _mm256_cmp_ps(_mm256_add_ps(distances[p], extent), _mm256_setzero_ps(), _CMP_LT_OQ));
+		}
+	}
+	int out_mask = _mm256_movemask_ps(out);
+	for (size_t lane = 0; lane < kGroupSize; ++lane) {
+		visible_[first + lane] = (out_mask >> lane & 1) ? 0 : 1;
+	}
+#elif FRUSTUM_CULLER_SSE
+	// Two halves of four
+	for (size_t half = first; half < first + kGroupSize; half += 4) {
+		__m128 cx = _mm_loadu_ps(&center_x_[half]);
+		__m128 cy = _mm_loadu_ps(&center_y_[half]);
+		__m128 cz = _mm_loadu_ps(&center_z_[half]);
+		__m128 radius = _mm_loadu_ps(&radius_[half]);
+		__m128 negative_radius = _mm_sub_ps(_mm_setzero_ps(), radius);
+		__m128 out = _mm_setzero_ps();
+		__m128 crossing = _mm_setzero_ps();
+		__m128 distances[6];
+		for (int p = 0; p < 6; ++p) {
+			const glm::vec4& plane = frustum.planes[p];
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), cx), _mm_mul_ps(_mm_set1_ps(plane.y), cy)),
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), cz), _mm_set1_ps(plane.w)));
+			distances[p] = d;
+			out = _mm_or_ps(out, _mm_cmplt_ps(d, negative_radius));
+			crossing = _mm_or_ps(crossing, _mm_cmplt_ps(d, radius));
+		}
+		if (_mm_movemask_ps(_mm_andnot_ps(out, crossing)) != 0) {
+			__m128 ex = _mm_loadu_ps(&extent_x_[half]);
+			__m128 ey = _mm_loadu_ps(&extent_y_[half]);
+			__m128 ez = _mm_loadu_ps(&extent_z_[half]);
+			for (int p = 0; p < 6; ++p) {
+				glm::vec3 normal = glm::abs(glm::vec3(frustum.planes[p]));
+				__m128 extent = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(normal.x), ex), _mm_mul_ps(_mm_set1_ps(normal.y), ey)),
+					_mm_mul_ps(_mm_set1_ps(normal.z), ez));
+				out = _mm_or_ps(out, _mm_cmplt_ps(_mm_add_ps(distances[p], extent), _mm_setzero_ps()));
+			}
+		}
+		int out_mask = _mm_movemask_ps(out);
+		for (size_t lane = 0; lane < 4; ++lane) {
+			visible_[half + lane] = (out_mask >> lane & 1) ? 0 : 1;
+		}
+	}
+#else
+	for (size_t i = first; i < first + kGroupSize; ++i) {
+		bool out = false;
+		bool crossing = false;
+		float distances[6];
+		for (int p = 0; p < 6 && !out; ++p) {
+			const glm::vec4& plane = frustum.planes[p];
+			float d = plane.x * center_x_[i] + plane.y * center_y_[i] + plane.z * center_z_[i] + plane.w;
+			distances[p] = d;
+			out = d < -radius_[i];
+			crossing = crossing || d < radius_[i];
+		}
+		for (int p = 0; p < 6 && !out && crossing; ++p) {
+			glm::vec3 normal = glm::abs(glm::vec3(frustum.planes[p]));
+			float extent = normal.x * extent_x_[i] + normal.y * extent_y_[i] + normal.z * extent_z_[i];
+			out = distances[p] + extent < 0.0f;
+		}
+		visible_[i] = out ? 0 : 1;
+	}
+#endif
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Bounds.h"
+
+// The six planes of a view-projection matrix (Gribb/Hartmann), normals pointing inside and normalized so
+// plane distances are world units
+struct Frustum {
+	glm::vec4 planes[6];
+
+	static Frustum FromMatrix(const glm::mat4& view_projection);
+};
+
+// Visibility of many world space bounds against one frustum. Bounds are kept as SoA arrays of centers,
+// extents and bounding sphere radii padded to whole SIMD groups, so one SSE (or AVX) instruction tests 4 (8)
+// of them against a plane. The sphere test runs first and settles most bounds, the box test only runs for
+// groups with a sphere crossing a plane. Large arrays are split over all hardware threads.
+class FrustumCuller
+{
+public:
+	void Clear();
+	// Index for Visible
+	size_t Add(const Aabb& bounds);
+	size_t Size() const;
+
+	void Cull(const Frustum& frustum);
+	bool Visible(size_t index) const;
+	glm::vec3 Center(size_t index) const;
+
+	// Bounds tested and visible in the last Cull
+	size_t VisibleCount() const;
+
+private:
+	static const size_t kGroupSize = 8;
+	// Below this many bounds the threads cost more than they save
+	static const size_t kParallelThreshold = 16 * 1024;
+	static const size_t kGroupsPerJob = 256;
+
+	std::vector<float> center_x_, center_y_, center_z_;
+	std::vector<float> extent_x_, extent_y_, extent_z_;
+	std::vector<float> radius_;
+	std::vector<unsigned char> visible_;
+	size_t count_ = 0;
+	size_t visible_count_ = 0;
+
+	void CullGroup(const Frustum& frustum, size_t first);
+};
@@ -0,0 +1,39 @@
+#include "GBuffer.h"
+
+#include <glad/glad.h>
+
+#include <iostream>
+
+void GBuffer::Begin(int width, int height)
+{
+	if (!framebuffer_ || width != width_ || height != height_) {
+		width_ = width;
+		height_ = height;
+		framebuffer_.reset();
+		framebuffer_ = std::make_unique<Framebuffer>();
+		unsigned int w = static_cast<unsigned int>(width), h = static_cast<unsigned int>(height);
+		textures_[0] = framebuffer_->AttachColorBuffer(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, w, h);
+		textures_[1] = framebuffer_->AttachColorBuffer(GL_RG16, GL_RG, GL_UNSIGNED_SHORT, w, h);
+		textures_[2] = framebuffer_->AttachColorBuffer(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, w, h);
+		textures_[3] = framebuffer_->AttachDepthTexture(w, h);
+		if (!framebuffer_->CheckStatus()) {
+			std::cout << "ERROR::GBUFFER::FRAMEBUFFER_INCOMPLETE " << width << "x" << height << std::endl;
+		}
+	}
+
+	framebuffer_->Bind();
+	framebuffer_->Clear();
+}
+
+void GBuffer::End()
+{
+	framebuffer_->Unbind();
+}
+
+void GBuffer::BindTextures() const
+{
+	for (unsigned int i = 0; i < kTextureCount; ++i) {
+		glActiveTexture(GL_TEXTURE0 + kFirstTextureSlot + i);
+		glBindTexture(GL_TEXTURE_2D, textures_[i]);
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <memory>
+
+#include "../opengl/Framebuffer.h"
+
+// Render targets of the deferred path: albedo (RGBA8), octahedral normal (RG16), occlusion/roughness/metallic
+// (RGBA8) and depth (32F). gbuffer.frag fills them with the material of the visible surface, deferred.frag
+// shades each pixel once from them. The targets follow the window size and are only created once used.
+class GBuffer
+{
+public:
+	// albedo, normal, ORM and depth on the deferred.frag slots 3-6
+	static const unsigned int kFirstTextureSlot = 3;
+	static const unsigned int kTextureCount = 4;
+
+	// Recreates the targets if the size changed, then binds and clears them
+	void Begin(int width, int height);
+	// Back to the default framebuffer
+	void End();
+	void BindTextures() const;
+
+private:
+	std::unique_ptr<Framebuffer> framebuffer_;
+	int width_ = 0;
+	int height_ = 0;
+	unsigned int textures_[kTextureCount] = { 0, 0, 0, 0 };
+};
@@ -0,0 +1,31 @@
+#include "Hash.h"
+
+#include <fstream>
+#include <vector>
+
+uint64_t Hash::HashFile(const std::string& path, uint64_t hash)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		return 0;
+	}
+
+	// Read in large chunks, HDR maps can easily be tens of megabytes
+	std::vector<char> chunk(1 << 20);
+	while (file) {
+		file.read(chunk.data(), chunk.size());
+		hash = Fnv1a64(chunk.data(), static_cast<size_t>(file.gcount()), hash);
+	}
+	return hash;
+}
+
+std::string Hash::ToHex(uint64_t hash)
+{
+	const char* digits = "0123456789abcdef";
+	std::string hex(16, '0');
+	for (int i = 15; i >= 0; --i) {
+		hex[i] = digits[hash & 0xF];
+		hash >>= 4;
+	}
+	return hex;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// FNV-1a hashing used to key on-disk caches and shader uniforms
+namespace Hash {
+	const uint64_t kFnvOffsetBasis = 14695981039346656037ull;
+	const uint64_t kFnvPrime = 1099511628211ull;
+	const uint32_t kFnv32OffsetBasis = 2166136261u;
+	const uint32_t kFnv32Prime = 16777619u;
+
+	inline uint64_t Fnv1a64(const void* data, size_t size, uint64_t hash = kFnvOffsetBasis)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; ++i) {
+			hash ^= bytes[i];
+			hash *= kFnvPrime;
+		}
+		return hash;
+	}
+
+	inline uint64_t Fnv1a64(const std::string& str, uint64_t hash = kFnvOffsetBasis)
+	{
+		return Fnv1a64(str.data(), str.size(), hash);
+	}
+
+	// Null-terminated string, usable in constant expressions
+	constexpr uint32_t Fnv1a32(const char* str, uint32_t hash = kFnv32OffsetBasis)
+	{
+		for (; *str != '\0'; ++str) {
+			hash ^= static_cast<unsigned char>(*str);
+			hash *= kFnv32Prime;
+		}
+		return hash;
+	}
+
+	// Hashes the full contents of a file, returns 0 if the file can't be opened
+	uint64_t HashFile(const std::string& path, uint64_t hash = kFnvOffsetBasis);
+
+	std::string ToHex(uint64_t hash);
+}
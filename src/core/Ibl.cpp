@@ -1,204 +1,187 @@
 #include "Ibl.h"
 
 #include <glad/glad.h>
-#include <stb_image.h>
 
 #include "../opengl/Shader.h"
-#include "../opengl/Texture2D.h"
 #include "Renderer.h"
+#include "IblCache.h"
+#include "IblBaker.h"
+#include "BrdfLutData.h"
 
-#include <iostream>
+#include <algorithm>
 
-unsigned int Ibl::CubemapFromHDRI(const std::string& path, unsigned int& capture_fbo, unsigned int& capture_rbo, Shader& equirectangular_to_cubemap,
-	const glm::mat4& capture_projection, const glm::mat4 capture_views[], Renderer& renderer)
+unsigned int Ibl::AllocateCubemap(unsigned int size, unsigned int mip_levels, unsigned int internal_format)
 {
-	std::string ext = path.substr(path.find_last_of(".") + 1);
-	std::cout << "Extension: " << ext << std::endl;
-	assert((ext != "hdr" || ext != "hdri" || ext != " hdr") && "Cubemap::INVALID_FILE_FORMAT");
-
-	Texture2D hdr_map(path, GL_RGBA16F);
-
-	/* Framebuffer setup */
-	// 1. Create framebuffer and renderbuffer
-	//unsigned int capture_fbo, capture_rbo;
-	glGenFramebuffers(1, &capture_fbo);
-	glGenRenderbuffers(1, &capture_rbo);
-
-	glBindFramebuffer(GL_FRAMEBUFFER, capture_fbo);
-	glBindRenderbuffer(GL_RENDERBUFFER, capture_rbo);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 512, 512);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, capture_rbo);
-
-	// 2. Create cubemap
-	unsigned int env_cubemap;
-	glGenTextures(1, &env_cubemap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, env_cubemap);
-	for (unsigned int i = 0; i < 6; ++i)
-	{
-		// note that we store each face with 16 bit floating point values
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F,
-			512, 512, 0, GL_RGB, GL_FLOAT, nullptr);
-	}
+	unsigned int cubemap;
+	glGenTextures(1, &cubemap);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+	glTexStorage2D(GL_TEXTURE_CUBE_MAP, mip_levels, internal_format, size, size);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, mip_levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	glm::mat4 captureProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
-	glm::mat4 captureViews[] =
-	{
-	   glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-	   glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-	   glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  1.0f,  0.0f), glm::vec3(0.0f,  0.0f,  1.0f)),
-	   glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f,  0.0f), glm::vec3(0.0f,  0.0f, -1.0f)),
-	   glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  0.0f,  1.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-	   glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  0.0f, -1.0f), glm::vec3(0.0f, -1.0f,  0.0f))
-	};
-
-	// convert HDR equirectangular environment map to cubemap equivalent
-	equirectangular_to_cubemap.Bind();
-	equirectangular_to_cubemap.SetInt("equirectangularMap", 0);
-	equirectangular_to_cubemap.SetMat4f("projection", captureProjection);
-	hdr_map.Bind(0);
-
-	glViewport(0, 0, 512, 512); // don't forget to configure the viewport to the capture dimensions.
-	glBindFramebuffer(GL_FRAMEBUFFER, capture_fbo);
-	for (unsigned int i = 0; i < 6; ++i)
-	{
-		equirectangular_to_cubemap.SetMat4f("view", captureViews[i]);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-			GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, env_cubemap, 0);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		renderer.DrawCube(); // renders a 1x1 cube
-	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-	return env_cubemap;
+	return cubemap;
 }
 
-unsigned int Ibl::CreateIrradianceMap(unsigned int& capture_fbo, unsigned int& capture_rbo, Shader& irradiance_shader, unsigned int env_cubemap,
-	const glm::mat4& capture_projection, const glm::mat4 capture_views[], Renderer& renderer)
+unsigned int Ibl::UploadEquirectangular(const float* pixels, int width, int height)
 {
-	unsigned int irradianceMap;
-	glGenTextures(1, &irradianceMap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, irradianceMap);
-	for (unsigned int i = 0; i < 6; ++i)
-	{
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 32, 32, 0, GL_RGB, GL_FLOAT, nullptr);
-	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGB, GL_FLOAT, pixels);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	return texture;
+}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, capture_fbo);
-	glBindRenderbuffer(GL_RENDERBUFFER, capture_rbo);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 32, 32);
-
-	// pbr: solve diffuse integral by convolution to create an irradiance (cube)map.
-	// -----------------------------------------------------------------------------
-	irradiance_shader.Bind();
-	irradiance_shader.SetInt("environmentMap", 0);
-	irradiance_shader.SetMat4f("projection", capture_projection);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, env_cubemap);
+void Ibl::RenderCubemapFace(unsigned int capture_fbo, Shader& shader, const glm::mat4& capture_view, unsigned int cubemap,
+	unsigned int face, unsigned int mip, unsigned int size, Renderer& renderer)
+{
+	unsigned int mip_size = std::max(1u, size >> mip);
+	shader.Bind();
+	shader.SetMat4f("view", capture_view);
 
-	glViewport(0, 0, 32, 32); // don't forget to configure the viewport to the capture dimensions.
 	glBindFramebuffer(GL_FRAMEBUFFER, capture_fbo);
-	for (unsigned int i = 0; i < 6; ++i)
-	{
-		irradiance_shader.SetMat4f("view", capture_views[i]);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, irradianceMap, 0);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		renderer.DrawCube();
-	}
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, cubemap, mip);
+	glViewport(0, 0, mip_size, mip_size);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	renderer.DrawCube();
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-	return irradianceMap;
 }
 
-unsigned int Ibl::CreatePrefilterMap(unsigned int& capture_fbo, unsigned int& capture_rbo, Shader& prefilter_shader, unsigned int env_cubemap,
-	const glm::mat4& capture_projection, const glm::mat4 capture_views[], Renderer& renderer)
+void Ibl::DispatchPrefilterMip(Shader& prefilter_compute_shader, unsigned int env_cubemap, unsigned int prefilter_map, unsigned int mip, const BakeSettings& settings)
 {
-	unsigned int prefilter_map;
-	glGenTextures(1, &prefilter_map);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, prefilter_map);
-	for (unsigned int i = 0; i < 6; ++i)
-	{
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 128, 128, 0, GL_RGB, GL_FLOAT, nullptr);
-	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR); // be sure to set minification filter to mip_linear
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	// generate mipmaps for the cubemap so OpenGL automatically allocates the required memory.
-	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
-
-	// pbr: run a quasi monte-carlo simulation on the environment lighting to create a prefilter (cube)map.
-	// ----------------------------------------------------------------------------------------------------
-	prefilter_shader.Bind();
-	prefilter_shader.SetInt("environmentMap", 0);
-	prefilter_shader.SetMat4f("projection", capture_projection);
+	const unsigned int group_size = 8; // local_size_x/y of prefilter.comp
+	unsigned int mip_size = std::max(1u, settings.prefilter_size >> mip);
+	float roughness = PrefilterRoughness(mip, settings.prefilter_mips);
+
+	prefilter_compute_shader.Bind();
+	prefilter_compute_shader.SetInt("sampleCount", settings.sample_count);
+	prefilter_compute_shader.SetFloat("resolution", static_cast<float>(settings.env_size));
+	prefilter_compute_shader.SetFloat("roughness", roughness);
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, env_cubemap);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, capture_fbo);
-	unsigned int max_mip_levels = 5;
-	for (unsigned int mip = 0; mip < max_mip_levels; ++mip)
-	{
-		// reisze framebuffer according to mip-level size.
-		unsigned int mip_width = static_cast<unsigned int>(128 * std::pow(0.5, mip));
-		unsigned int mip_height = static_cast<unsigned int>(128 * std::pow(0.5, mip));
-		glBindRenderbuffer(GL_RENDERBUFFER, capture_rbo);
-		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mip_width, mip_height);
-		glViewport(0, 0, mip_width, mip_height);
-
-		float roughness = (float)mip / (float)(max_mip_levels - 1);
-		prefilter_shader.SetFloat("roughness", roughness);
-		for (unsigned int i = 0; i < 6; ++i)
-		{
-			prefilter_shader.SetMat4f("view", capture_views[i]);
-			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, prefilter_map, mip);
-
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-			renderer.DrawCube();
-		}
-	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-	return prefilter_map;
+	// layered binding, the z dimension of the dispatch selects the face
+	glBindImageTexture(0, prefilter_map, mip, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+	glDispatchCompute((mip_size + group_size - 1) / group_size, (mip_size + group_size - 1) / group_size, 6);
+	glBindImageTexture(0, 0, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
 }
 
-unsigned int Ibl::CreateBRDFLookupTexture(unsigned int& capture_fbo, unsigned int& capture_rbo, Shader& brdf_shader, Renderer& renderer)
+unsigned int Ibl::CreateBRDFLookupTexture()
 {
 	unsigned int brdf_lut_texture;
 	glGenTextures(1, &brdf_lut_texture);
-
-	// pre-allocate enough memory for the LUT texture.
 	glBindTexture(GL_TEXTURE_2D, brdf_lut_texture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, 512, 512, 0, GL_RG, GL_FLOAT, 0);
-	// be sure to set wrapping mode to GL_CLAMP_TO_EDGE
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, BrdfLutData::kSize, BrdfLutData::kSize, 0, GL_RG, GL_HALF_FLOAT, BrdfLutData::kTexels);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	return brdf_lut_texture;
+}
 
-	// then re-configure capture framebuffer object and render screen-space quad with BRDF shader.
-	glBindFramebuffer(GL_FRAMEBUFFER, capture_fbo);
-	glBindRenderbuffer(GL_RENDERBUFFER, capture_rbo);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 512, 512);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, brdf_lut_texture, 0);
+CachedTexture Ibl::ReadbackTexture(unsigned int texture, unsigned int target, unsigned int internal_format, unsigned int mip_levels)
+{
+	CachedTexture cached;
+	cached.target = target;
+	cached.internal_format = internal_format;
+	cached.format = internal_format == GL_RG16F ? GL_RG : GL_RGB;
+	cached.type = GL_HALF_FLOAT;
+	cached.mip_levels = mip_levels;
+	cached.faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+
+	unsigned int components = cached.format == GL_RG ? 2 : 3;
+	glBindTexture(target, texture);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+	int width = 0, height = 0;
+	unsigned int face_target = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : target;
+	glGetTexLevelParameteriv(face_target, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(face_target, 0, GL_TEXTURE_HEIGHT, &height);
+	cached.width = width;
+	cached.height = height;
+
+	for (unsigned int mip = 0; mip < mip_levels; ++mip)
+	{
+		unsigned int mip_width = std::max(1u, cached.width >> mip);
+		unsigned int mip_height = std::max(1u, cached.height >> mip);
+		for (unsigned int face = 0; face < cached.faces; ++face)
+		{
+			// Store as half floats, the textures are 16 bit on the GPU anyway so this is lossless
+			std::vector<unsigned char> image(mip_width * mip_height * components * sizeof(unsigned short));
+			glGetTexImage(face_target + face, mip, cached.format, cached.type, image.data());
+			cached.images.push_back(std::move(image));
+		}
+	}
 
-	glViewport(0, 0, 512, 512);
-	brdf_shader.Bind();
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	renderer.DrawQuad();
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	return cached;
+}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	return brdf_lut_texture;
-}
\ No newline at end of file
+unsigned int Ibl::UploadTexture(const CachedTexture& cached)
+{
+	if (cached.images.size() != static_cast<size_t>(cached.mip_levels) * cached.faces) {
+		return 0;
+	}
+
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	glBindTexture(cached.target, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	unsigned int face_target = cached.target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : cached.target;
+	for (unsigned int mip = 0; mip < cached.mip_levels; ++mip)
+	{
+		unsigned int mip_width = std::max(1u, cached.width >> mip);
+		unsigned int mip_height = std::max(1u, cached.height >> mip);
+		for (unsigned int face = 0; face < cached.faces; ++face)
+		{
+			glTexImage2D(face_target + face, mip, cached.internal_format, mip_width, mip_height, 0, cached.format, cached.type,
+				cached.images[mip * cached.faces + face].data());
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	glTexParameteri(cached.target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(cached.target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	if (cached.target == GL_TEXTURE_CUBE_MAP) {
+		glTexParameteri(cached.target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	}
+	glTexParameteri(cached.target, GL_TEXTURE_MIN_FILTER, cached.mip_levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(cached.target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(cached.target, GL_TEXTURE_MAX_LEVEL, cached.mip_levels - 1);
+
+	return texture;
+}
+
+void Ibl::DeleteMaps(EnvironmentMaps& maps)
+{
+	glDeleteTextures(1, &maps.env_cubemap);
+	glDeleteTextures(1, &maps.irradiance_map);
+	glDeleteTextures(1, &maps.prefilter_map);
+	maps = EnvironmentMaps();
+}
+
+std::vector<CachedTexture> Ibl::ReadbackMaps(const EnvironmentMaps& maps, const BakeSettings& settings)
+{
+	std::vector<CachedTexture> textures;
+	textures.push_back(ReadbackTexture(maps.env_cubemap, GL_TEXTURE_CUBE_MAP, GL_RGB16F, 1));
+	if (settings.sh_irradiance) {
+		textures.push_back(IblBaker::ToCachedTexture(maps.irradiance_sh));
+	}
+	else {
+		textures.push_back(ReadbackTexture(maps.irradiance_map, GL_TEXTURE_CUBE_MAP, GL_RGB16F, 1));
+	}
+	textures.push_back(ReadbackTexture(maps.prefilter_map, GL_TEXTURE_CUBE_MAP, GL_RGB16F, settings.prefilter_mips));
+	return textures;
+}
@@ -1,23 +1,84 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <string>
 #include <thread>
+#include <vector>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 class Shader;
 class Renderer;
+struct CachedTexture;
 
 // Utiliy functions for Image-Based Lightning
 namespace Ibl {
-	unsigned int CubemapFromHDRI(const std::string& path, unsigned int& capture_fbo, unsigned int& capture_rbo, Shader& equirectangular_to_cubemap,
-		const glm::mat4& capture_projection, const glm::mat4 capture_views[], Renderer& renderer);
+	// How the prefilter map is baked, raster draws one cube per face and mip, compute does one dispatch per mip
+	enum class Backend {
+		Raster,
+		Compute,
+	};
 
-	unsigned int CreateIrradianceMap(unsigned int& capture_fbo, unsigned int& capture_rbo, Shader& irradiance_shader, unsigned int env_cubemap,
-		const glm::mat4& capture_projection, const glm::mat4 capture_views[], Renderer& renderer);
+	// Resolutions and sample counts of the bake passes, these are also part of the cache key
+	struct BakeSettings {
+		unsigned int env_size = 512;
+		unsigned int irradiance_size = 32;
+		unsigned int prefilter_size = 128;
+		unsigned int prefilter_mips = 5;
+		unsigned int sample_count = 1024;
+		// Store diffuse irradiance as 9 SH coefficients instead of convolving an irradiance cubemap
+		bool sh_irradiance = true;
+		Backend backend = Backend::Raster;
 
-	unsigned int CreatePrefilterMap(unsigned int& capture_fbo, unsigned int& capture_rbo, Shader& prefilter_shader, unsigned int env_cubemap,
-		const glm::mat4& capture_projection, const glm::mat4 capture_views[], Renderer& renderer);
+		// Copy with prefilter_mips clamped to [1, log2(prefilter_size) + 1], the levels a prefilter_size cubemap has
+		BakeSettings Validated() const
+		{
+			BakeSettings validated = *this;
+			validated.prefilter_size = std::max(1u, prefilter_size);
+			unsigned int max_mips = 0;
+			for (unsigned int size = validated.prefilter_size; size > 0; size >>= 1) {
+				max_mips++;
+			}
+			validated.prefilter_mips = std::min(std::max(1u, prefilter_mips), max_mips);
+			return validated;
+		}
+	};
 
-	unsigned int CreateBRDFLookupTexture(unsigned int& capture_fbo, unsigned int& capture_rbo, Shader& brdf_shader, Renderer& renderer);
-}
\ No newline at end of file
+	// Roughness the prefilter map stores at `mip`, a single level is the mirror reflection
+	inline float PrefilterRoughness(unsigned int mip, unsigned int mip_levels)
+	{
+		return mip_levels > 1 ? (float)mip / (float)(mip_levels - 1) : 0.0f;
+	}
+
+	// GPU resources of one baked environment
+	struct EnvironmentMaps {
+		unsigned int env_cubemap = 0;
+		unsigned int irradiance_map = 0; // 0 when irradiance is stored as SH
+		unsigned int prefilter_map = 0;
+		std::array<glm::vec3, 9> irradiance_sh{};
+	};
+
+	void DeleteMaps(EnvironmentMaps& maps);
+
+	// Single steps of the bake passes, EnvironmentLoader spreads them over several frames
+	unsigned int AllocateCubemap(unsigned int size, unsigned int mip_levels, unsigned int internal_format);
+	// Uploads a decoded, bottom-up RGB float equirectangular map with mipmaps
+	unsigned int UploadEquirectangular(const float* pixels, int width, int height);
+	// Binds the shader, sets its view matrix and draws one face of `cubemap` at `mip`. Other uniforms and textures are left to the caller.
+	void RenderCubemapFace(unsigned int capture_fbo, Shader& shader, const glm::mat4& capture_view, unsigned int cubemap,
+		unsigned int face, unsigned int mip, unsigned int size, Renderer& renderer);
+	// One mip of the prefilter map from prefilter.comp, needs no framebuffer. Sample counts above 1024 are clamped.
+	void DispatchPrefilterMip(Shader& prefilter_compute_shader, unsigned int env_cubemap, unsigned int prefilter_map, unsigned int mip, const BakeSettings& settings);
+
+	// Uploads the precomputed LUT from BrdfLutData.h (see tools/BrdfLutGen.cpp), it never needs rebaking
+	unsigned int CreateBRDFLookupTexture();
+
+	// Reads every face and mip level of a baked texture back into CPU memory
+	CachedTexture ReadbackTexture(unsigned int texture, unsigned int target, unsigned int internal_format, unsigned int mip_levels);
+	// Creates a texture from cached data, returns 0 if the data is incomplete
+	unsigned int UploadTexture(const CachedTexture& texture);
+
+	// The textures of `maps` in the order IblCache stores them
+	std::vector<CachedTexture> ReadbackMaps(const EnvironmentMaps& maps, const BakeSettings& settings);
+}
@@ -0,0 +1,535 @@
+#include "IblBaker.h"
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include "Parallel.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IBL_BAKER_SSE 1
+#endif
+
+namespace {
+	const float kPi = 3.14159265359f;
+
+	// Tangent-space sample directions stored as SoA so four of them can be rotated per SSE instruction.
+	// Padded with zero-weight samples to a multiple of four.
+	struct SampleTable {
+		std::vector<float> x, y, z, weight;
+		float total_weight = 0.0f;
+		size_t count = 0;
+
+		void Push(float sx, float sy, float sz, float w)
+		{
+			x.push_back(sx); y.push_back(sy); z.push_back(sz); weight.push_back(w);
+			total_weight += w;
+			count++;
+		}
+
+		void Pad()
+		{
+			while (x.size() % 4 != 0) {
+				x.push_back(0.0f); y.push_back(0.0f); z.push_back(1.0f); weight.push_back(0.0f);
+			}
+		}
+	};
+
+	// GL cube map face selection, see the OpenGL 4.6 spec table 8.19
+	glm::vec3 FaceTexelDirection(unsigned int face, float s, float t)
+	{
+		float sc = 2.0f * s - 1.0f;
+		float tc = 2.0f * t - 1.0f;
+		switch (face)
+		{
+		case 0: return glm::vec3(1.0f, -tc, -sc);
+		case 1: return glm::vec3(-1.0f, -tc, sc);
+		case 2: return glm::vec3(sc, 1.0f, tc);
+		case 3: return glm::vec3(sc, -1.0f, -tc);
+		case 4: return glm::vec3(sc, -tc, 1.0f);
+		default: return glm::vec3(-sc, -tc, -1.0f);
+		}
+	}
+
+	// Bilinear fetch with GL_CLAMP_TO_EDGE on every face (seamless filtering is not enabled on the GL side either)
+	inline void SampleCubemap(const IblBaker::Cubemap& cubemap, float x, float y, float z, float* out)
+	{
+		float ax = std::fabs(x), ay = std::fabs(y), az = std::fabs(z);
+		unsigned int face;
+		float sc, tc, ma;
+		if (ax >= ay && ax >= az) {
+			face = x >= 0.0f ? 0 : 1;
+			sc = x >= 0.0f ? -z : z;
+			tc = -y;
+			ma = ax;
+		}
+		else if (ay >= az) {
+			face = y >= 0.0f ? 2 : 3;
+			sc = x;
+			tc = y >= 0.0f ? z : -z;
+			ma = ay;
+		}
+		else {
+			face = z >= 0.0f ? 4 : 5;
+			sc = z >= 0.0f ? x : -x;
+			tc = -y;
+			ma = az;
+		}
+
+		int size = static_cast<int>(cubemap.size);
+		float u = (0.5f * (sc / ma) + 0.5f) * size - 0.5f;
+		float v = (0.5f * (tc / ma) + 0.5f) * size - 0.5f;
+		int x0 = static_cast<int>(std::floor(u));
+		int y0 = static_cast<int>(std::floor(v));
+		float fx = u - x0;
+		float fy = v - y0;
+		int x1 = std::min(std::max(x0 + 1, 0), size - 1);
+		int y1 = std::min(std::max(y0 + 1, 0), size - 1);
+		x0 = std::min(std::max(x0, 0), size - 1);
+		y0 = std::min(std::max(y0, 0), size - 1);
+
+		const float* texels = cubemap.Face(face);
+		const float* p00 = texels + (y0 * size + x0) * 3;
+		const float* p10 = texels + (y0 * size + x1) * 3;
+		const float* p01 = texels + (y1 * size + x0) * 3;
+		const float* p11 = texels + (y1 * size + x1) * 3;
+		for (int c = 0; c < 3; ++c) {
+			float top = p00[c] + (p10[c] - p00[c]) * fx;
+			float bottom = p01[c] + (p11[c] - p01[c]) * fx;
+			out[c] = top + (bottom - top) * fy;
+		}
+	}
+
+	// Bilinear fetch with GL_REPEAT wrapping
+	inline void SampleImage(const IblBaker::Image& image, float s, float t, float* out)
+	{
+		int width = static_cast<int>(image.width);
+		int height = static_cast<int>(image.height);
+		float u = s * width - 0.5f;
+		float v = t * height - 0.5f;
+		int x0 = static_cast<int>(std::floor(u));
+		int y0 = static_cast<int>(std::floor(v));
+		float fx = u - x0;
+		float fy = v - y0;
+		auto wrap = [](int i, int n) { i %= n; return i < 0 ? i + n : i; };
+		int x1 = wrap(x0 + 1, width), y1 = wrap(y0 + 1, height);
+		x0 = wrap(x0, width);
+		y0 = wrap(y0, height);
+
+		const float* p00 = image.pixels.data() + (static_cast<size_t>(y0) * width + x0) * 3;
+		const float* p10 = image.pixels.data() + (static_cast<size_t>(y0) * width + x1) * 3;
+		const float* p01 = image.pixels.data() + (static_cast<size_t>(y1) * width + x0) * 3;
+		const float* p11 = image.pixels.data() + (static_cast<size_t>(y1) * width + x1) * 3;
+		for (int c = 0; c < 3; ++c) {
+			float top = p00[c] + (p10[c] - p00[c]) * fx;
+			float bottom = p01[c] + (p11[c] - p01[c]) * fx;
+			out[c] = top + (bottom - top) * fy;
+		}
+	}
+
+	// Rotates every tangent-space sample into the frame (tangent, bitangent, normal) and accumulates
+	// the weighted cubemap fetches. The rotation runs four samples per instruction; the fetch itself is a
+	// gather and stays scalar.
+	glm::vec3 ConvolveSamples(const IblBaker::Cubemap& cubemap, const SampleTable& table,
+		const glm::vec3& tangent, const glm::vec3& bitangent, const glm::vec3& normal)
+	{
+		float sum[3] = { 0.0f, 0.0f, 0.0f };
+		alignas(16) float wx[4], wy[4], wz[4];
+		float texel[3];
+
+		for (size_t i = 0; i < table.x.size(); i += 4)
+		{
+#ifdef IBL_BAKER_SSE
+			__m128 sx = _mm_loadu_ps(&table.x[i]);
+			__m128 sy = _mm_loadu_ps(&table.y[i]);
+			__m128 sz = _mm_loadu_ps(&table.z[i]);
+			__m128 dx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, _mm_set1_ps(tangent.x)), _mm_mul_ps(sy, _mm_set1_ps(bitangent.x))), _mm_mul_ps(sz, _mm_set1_ps(normal.x)));
+			__m128 dy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, _mm_set1_ps(tangent.y)), _mm_mul_ps(sy, _mm_set1_ps(bitangent.y))), _mm_mul_ps(sz, _mm_set1_ps(normal.y)));
+			__m128 dz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, _mm_set1_ps(tangent.z)), _mm_mul_ps(sy, _mm_set1_ps(bitangent.z))), _mm_mul_ps(sz, _mm_set1_ps(normal.z)));
+			_mm_store_ps(wx, dx);
+			_mm_store_ps(wy, dy);
+			_mm_store_ps(wz, dz);
+#else
+			for (int lane = 0; lane < 4; ++lane) {
+				wx[lane] = table.x[i + lane] * tangent.x + table.y[i + lane] * bitangent.x + table.z[i + lane] * normal.x;
+				wy[lane] = table.x[i + lane] * tangent.y + table.y[i + lane] * bitangent.y + table.z[i + lane] * normal.y;
+				wz[lane] = table.x[i + lane] * tangent.z + table.y[i + lane] * bitangent.z + table.z[i + lane] * normal.z;
+			}
+#endif
+			for (int lane = 0; lane < 4; ++lane) {
+				float weight = table.weight[i + lane];
+				if (weight <= 0.0f) {
+					continue;
+				}
+				SampleCubemap(cubemap, wx[lane], wy[lane], wz[lane], texel);
+				sum[0] += texel[0] * weight;
+				sum[1] += texel[1] * weight;
+				sum[2] += texel[2] * weight;
+			}
+		}
+		return glm::vec3(sum[0], sum[1], sum[2]);
+	}
+
+	float RadicalInverseVdC(uint32_t bits)
+	{
+		bits = (bits << 16u) | (bits >> 16u);
+		bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+		bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+		bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+		bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+		return float(bits) * 2.3283064365386963e-10f;
+	}
+
+	// GGX half vector in tangent space (normal = +Z), matches ImportanceSampleGGX in the shaders
+	glm::vec3 ImportanceSampleGGX(uint32_t i, uint32_t count, float roughness)
+	{
+		float a = roughness * roughness;
+		float xi_x = float(i) / float(count);
+		float xi_y = RadicalInverseVdC(i);
+
+		float phi = 2.0f * kPi * xi_x;
+		float cos_theta = std::sqrt((1.0f - xi_y) / (1.0f + (a * a - 1.0f) * xi_y));
+		float sin_theta = std::sqrt(1.0f - cos_theta * cos_theta);
+		return glm::vec3(std::cos(phi) * sin_theta, std::sin(phi) * sin_theta, cos_theta);
+	}
+
+	float GeometrySchlickGGX(float NdotV, float roughness)
+	{
+		// note that we use a different k for IBL
+		float k = (roughness * roughness) / 2.0f;
+		return NdotV / (NdotV * (1.0f - k) + k);
+	}
+
+	void BuildFrame(const glm::vec3& N, const glm::vec3& up_hint, glm::vec3& tangent, glm::vec3& bitangent)
+	{
+		tangent = glm::normalize(glm::cross(up_hint, N));
+		bitangent = glm::normalize(glm::cross(N, tangent));
+	}
+
+	std::vector<unsigned char> ToHalf(const float* data, size_t count)
+	{
+		std::vector<unsigned char> bytes(count * sizeof(uint16_t));
+		uint16_t* halves = reinterpret_cast<uint16_t*>(bytes.data());
+		for (size_t i = 0; i < count; ++i) {
+			halves[i] = glm::packHalf1x16(data[i]);
+		}
+		return bytes;
+	}
+}
+
+bool IblBaker::LoadHDR(const std::string& path, Image& image)
+{
+	// The GL path uploads the map flipped, do the same so the faces line up
+	stbi_set_flip_vertically_on_load_thread(true);
+	int width = 0, height = 0, channels = 0;
+	float* data = stbi_loadf(path.c_str(), &width, &height, &channels, 3);
+	stbi_set_flip_vertically_on_load_thread(false);
+	if (!data) {
+		std::cout << "ERROR::IBL_BAKER::FAILED_TO_LOAD_IMAGE " << path << std::endl;
+		return false;
+	}
+
+	image.width = width;
+	image.height = height;
+	image.pixels.assign(data, data + static_cast<size_t>(width) * height * 3);
+	stbi_image_free(data);
+	return true;
+}
+
+IblBaker::Cubemap IblBaker::CubemapFromEquirectangular(const Image& equirectangular, unsigned int size)
+{
+	Cubemap cubemap;
+	cubemap.size = size;
+	cubemap.texels.resize(static_cast<size_t>(size) * size * 3 * 6);
+
+	// hdrmap.frag: direction -> spherical uv
+	const glm::vec2 inv_atan(0.1591f, 0.3183f);
+	Parallel::For(0, static_cast<size_t>(size) * 6, [&](size_t row_index) {
+		unsigned int face = static_cast<unsigned int>(row_index / size);
+		unsigned int y = static_cast<unsigned int>(row_index % size);
+		float* row = cubemap.Face(face) + static_cast<size_t>(y) * size * 3;
+		for (unsigned int x = 0; x < size; ++x) {
+			glm::vec3 v = glm::normalize(FaceTexelDirection(face, (x + 0.5f) / size, (y + 0.5f) / size));
+			glm::vec2 uv(std::atan2(v.z, v.x), std::asin(v.y));
+			uv = uv * inv_atan + 0.5f;
+			SampleImage(equirectangular, uv.x, uv.y, row + x * 3);
+		}
+	});
+
+	return cubemap;
+}
+
+IblBaker::Cubemap IblBaker::CreateIrradianceMap(const Cubemap& env_cubemap, unsigned int size)
+{
+	// irradiance.frag walks a fixed phi/theta grid, so the tangent-space samples and their
+	// cos * sin weights are identical for every texel and can be computed once
+	SampleTable table;
+	const float sample_delta = 0.025f;
+	for (float phi = 0.0f; phi < 2.0f * kPi; phi += sample_delta) {
+		for (float theta = 0.0f; theta < 0.5f * kPi; theta += sample_delta) {
+			table.Push(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta),
+				std::cos(theta) * std::sin(theta));
+		}
+	}
+	size_t sample_count = table.count;
+	table.Pad();
+
+	Cubemap irradiance;
+	irradiance.size = size;
+	irradiance.texels.resize(static_cast<size_t>(size) * size * 3 * 6);
+
+	Parallel::For(0, static_cast<size_t>(size) * 6, [&](size_t row_index) {
+		unsigned int face = static_cast<unsigned int>(row_index / size);
+		unsigned int y = static_cast<unsigned int>(row_index % size);
+		float* row = irradiance.Face(face) + static_cast<size_t>(y) * size * 3;
+		for (unsigned int x = 0; x < size; ++x) {
+			glm::vec3 N = glm::normalize(FaceTexelDirection(face, (x + 0.5f) / size, (y + 0.5f) / size));
+			glm::vec3 right, up;
+			BuildFrame(N, glm::vec3(0.0f, 1.0f, 0.0f), right, up);
+
+			glm::vec3 sum = ConvolveSamples(env_cubemap, table, right, up, N);
+			glm::vec3 result = kPi * sum * (1.0f / float(sample_count));
+			row[x * 3 + 0] = result.r;
+			row[x * 3 + 1] = result.g;
+			row[x * 3 + 2] = result.b;
+		}
+	});
+
+	return irradiance;
+}
+
+std::vector<IblBaker::Cubemap> IblBaker::CreatePrefilterMap(const Cubemap& env_cubemap, unsigned int size, unsigned int mip_levels, unsigned int sample_count)
+{
+	std::vector<Cubemap> mips(mip_levels);
+	for (unsigned int mip = 0; mip < mip_levels; ++mip)
+	{
+		float roughness = Ibl::PrefilterRoughness(mip, mip_levels);
+
+		// prefilter.frag assumes V = R = N, which makes L and NdotL depend only on the GGX sample and
+		// not on the texel. Reflect each half vector about +Z once and reuse the table for every texel.
+		SampleTable table;
+		for (uint32_t i = 0; i < sample_count; ++i) {
+			glm::vec3 H = ImportanceSampleGGX(i, sample_count, roughness);
+			glm::vec3 L = glm::normalize(2.0f * H.z * H - glm::vec3(0.0f, 0.0f, 1.0f));
+			float NdotL = std::max(L.z, 0.0f);
+			if (NdotL > 0.0f) {
+				table.Push(L.x, L.y, L.z, NdotL);
+			}
+		}
+		table.Pad();
+
+		Cubemap& target = mips[mip];
+		target.size = std::max(1u, size >> mip);
+		target.texels.resize(static_cast<size_t>(target.size) * target.size * 3 * 6);
+
+		Parallel::For(0, static_cast<size_t>(target.size) * 6, [&](size_t row_index) {
+			unsigned int face = static_cast<unsigned int>(row_index / target.size);
+			unsigned int y = static_cast<unsigned int>(row_index % target.size);
+			float* row = target.Face(face) + static_cast<size_t>(y) * target.size * 3;
+			for (unsigned int x = 0; x < target.size; ++x) {
+				glm::vec3 N = glm::normalize(FaceTexelDirection(face, (x + 0.5f) / target.size, (y + 0.5f) / target.size));
+				glm::vec3 up = std::fabs(N.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+				glm::vec3 tangent, bitangent;
+				BuildFrame(N, up, tangent, bitangent);
+
+				glm::vec3 result = ConvolveSamples(env_cubemap, table, tangent, bitangent, N) / table.total_weight;
+				row[x * 3 + 0] = result.r;
+				row[x * 3 + 1] = result.g;
+				row[x * 3 + 2] = result.b;
+			}
+		});
+	}
+
+	return mips;
+}
+
+std::vector<float> IblBaker::CreateBRDFLookup(unsigned int size, unsigned int sample_count)
+{
+	std::vector<float> lut(static_cast<size_t>(size) * size * 2);
+
+	Parallel::For(0, size, [&](size_t y) {
+		float roughness = (y + 0.5f) / size;
+
+		// Half vectors only depend on the row's roughness
+		std::vector<glm::vec3> half_vectors(sample_count);
+		for (uint32_t i = 0; i < sample_count; ++i) {
+			half_vectors[i] = ImportanceSampleGGX(i, sample_count, roughness);
+		}
+
+		for (unsigned int x = 0; x < size; ++x) {
+			float NdotV = (x + 0.5f) / size;
+			glm::vec3 V(std::sqrt(1.0f - NdotV * NdotV), 0.0f, NdotV);
+
+			float A = 0.0f;
+			float B = 0.0f;
+			for (const glm::vec3& H : half_vectors) {
+				glm::vec3 L = glm::normalize(2.0f * glm::dot(V, H) * H - V);
+				float NdotL = std::max(L.z, 0.0f);
+				float NdotH = std::max(H.z, 0.0f);
+				float VdotH = std::max(glm::dot(V, H), 0.0f);
+				if (NdotL > 0.0f) {
+					float G = GeometrySchlickGGX(NdotL, roughness) * GeometrySchlickGGX(std::max(NdotV, 0.0f), roughness);
+					float G_Vis = (G * VdotH) / (NdotH * NdotV);
+					float Fc = std::pow(1.0f - VdotH, 5.0f);
+					A += (1.0f - Fc) * G_Vis;
+					B += Fc * G_Vis;
+				}
+			}
+
+			float* texel = lut.data() + (y * size + x) * 2;
+			texel[0] = A / float(sample_count);
+			texel[1] = B / float(sample_count);
+		}
+	});
+
+	return lut;
+}
+
+std::array<glm::vec3, 9> IblBaker::ProjectIrradianceSH(const Cubemap& env_cubemap)
+{
+	unsigned int size = env_cubemap.size;
+
+	// Every face row reduces into its own partial sum so the threads never share an accumulator
+	struct Partial {
+		glm::dvec3 coefficients[9] = {};
+		double weight = 0.0;
+	};
+	std::vector<Partial> partials(static_cast<size_t>(size) * 6);
+
+	Parallel::For(0, partials.size(), [&](size_t row_index) {
+		unsigned int face = static_cast<unsigned int>(row_index / size);
+		unsigned int y = static_cast<unsigned int>(row_index % size);
+		const float* row = env_cubemap.Face(face) + static_cast<size_t>(y) * size * 3;
+		Partial& partial = partials[row_index];
+
+		for (unsigned int x = 0; x < size; ++x) {
+			float s = (x + 0.5f) / size;
+			float t = (y + 0.5f) / size;
+			glm::vec3 d = FaceTexelDirection(face, s, t);
+
+			// Solid angle of the texel: dA / (1 + u^2 + v^2)^(3/2)
+			float u = 2.0f * s - 1.0f;
+			float v = 2.0f * t - 1.0f;
+			float texel_area = 4.0f / (float(size) * float(size));
+			double solid_angle = texel_area / std::pow(1.0f + u * u + v * v, 1.5f);
+			d = glm::normalize(d);
+
+			const double basis[9] = {
+				0.282095,
+				0.488603 * d.y,
+				0.488603 * d.z,
+				0.488603 * d.x,
+				1.092548 * d.x * d.y,
+				1.092548 * d.y * d.z,
+				0.315392 * (3.0 * d.z * d.z - 1.0),
+				1.092548 * d.x * d.z,
+				0.546274 * (d.x * d.x - d.y * d.y),
+			};
+			glm::dvec3 radiance(row[x * 3 + 0], row[x * 3 + 1], row[x * 3 + 2]);
+			for (int i = 0; i < 9; ++i) {
+				partial.coefficients[i] += radiance * (basis[i] * solid_angle);
+			}
+			partial.weight += solid_angle;
+		}
+	});
+
+	glm::dvec3 coefficients[9] = {};
+	double total_weight = 0.0;
+	for (const Partial& partial : partials) {
+		for (int i = 0; i < 9; ++i) {
+			coefficients[i] += partial.coefficients[i];
+		}
+		total_weight += partial.weight;
+	}
+
+	// Renormalize the texel solid angles to exactly 4 PI, then apply the clamped cosine convolution
+	// (PI, 2PI/3, PI/4 per band) divided by PI, since the irradiance map stores irradiance / PI
+	const double band_scale[9] = { 1.0, 2.0 / 3.0, 2.0 / 3.0, 2.0 / 3.0, 0.25, 0.25, 0.25, 0.25, 0.25 };
+	double normalization = total_weight > 0.0 ? 4.0 * kPi / total_weight : 0.0;
+	std::array<glm::vec3, 9> irradiance_sh;
+	for (int i = 0; i < 9; ++i) {
+		irradiance_sh[i] = glm::vec3(coefficients[i] * (normalization * band_scale[i]));
+	}
+	return irradiance_sh;
+}
+
+CachedTexture IblBaker::ToCachedTexture(const std::vector<Cubemap>& mips)
+{
+	CachedTexture cached;
+	cached.target = GL_TEXTURE_CUBE_MAP;
+	cached.internal_format = GL_RGB16F;
+	cached.format = GL_RGB;
+	cached.type = GL_HALF_FLOAT;
+	cached.width = mips.empty() ? 0 : mips[0].size;
+	cached.height = cached.width;
+	cached.mip_levels = static_cast<unsigned int>(mips.size());
+	cached.faces = 6;
+
+	for (const Cubemap& mip : mips) {
+		size_t face_floats = static_cast<size_t>(mip.size) * mip.size * 3;
+		for (unsigned int face = 0; face < 6; ++face) {
+			cached.images.push_back(ToHalf(mip.Face(face), face_floats));
+		}
+	}
+	return cached;
+}
+
+CachedTexture IblBaker::ToCachedTexture(const std::vector<float>& brdf_lut, unsigned int size)
+{
+	CachedTexture cached;
+	cached.target = GL_TEXTURE_2D;
+	cached.internal_format = GL_RG16F;
+	cached.format = GL_RG;
+	cached.type = GL_HALF_FLOAT;
+	cached.width = size;
+	cached.height = size;
+	cached.images.push_back(ToHalf(brdf_lut.data(), brdf_lut.size()));
+	return cached;
+}
+
+CachedTexture IblBaker::ToCachedTexture(const std::array<glm::vec3, 9>& irradiance_sh)
+{
+	// Not a texture, the coefficients travel through the cache as a 9x1 RGB32F image
+	CachedTexture cached;
+	cached.target = GL_NONE;
+	cached.internal_format = GL_RGB32F;
+	cached.format = GL_RGB;
+	cached.type = GL_FLOAT;
+	cached.width = 9;
+	cached.height = 1;
+
+	std::vector<unsigned char> bytes(sizeof(glm::vec3) * irradiance_sh.size());
+	std::memcpy(bytes.data(), irradiance_sh.data(), bytes.size());
+	cached.images.push_back(std::move(bytes));
+	return cached;
+}
+
+bool IblBaker::Bake(const std::string& hdr_path, const Ibl::BakeSettings& settings, std::vector<CachedTexture>& textures)
+{
+	Image equirectangular;
+	if (!LoadHDR(hdr_path, equirectangular)) {
+		return false;
+	}
+
+	Cubemap env_cubemap = CubemapFromEquirectangular(equirectangular, settings.env_size);
+	std::vector<Cubemap> prefilter = CreatePrefilterMap(env_cubemap, settings.prefilter_size, settings.prefilter_mips, settings.sample_count);
+
+	textures.clear();
+	textures.push_back(ToCachedTexture(std::vector<Cubemap>{ env_cubemap }));
+	if (settings.sh_irradiance) {
+		textures.push_back(ToCachedTexture(ProjectIrradianceSH(env_cubemap)));
+	}
+	else {
+		textures.push_back(ToCachedTexture(std::vector<Cubemap>{ CreateIrradianceMap(env_cubemap, settings.irradiance_size) }));
+	}
+	textures.push_back(ToCachedTexture(prefilter));
+	return true;
+}
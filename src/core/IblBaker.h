@@ -0,0 +1,51 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Ibl.h"
+#include "IblCache.h"
+
+// CPU implementation of the IBL bake passes (hdrmap.frag, irradiance.frag, prefilter.frag, brdf.frag).
+// It needs no GL context, so environments can be baked on machines without a GPU. The results use the
+// same face order, row order and half float layout as the GL path and can be written straight to the cache.
+namespace IblBaker {
+	// Linear RGB float image, rows stored bottom-up like the flipped images the GL path uploads
+	struct Image {
+		unsigned int width = 0;
+		unsigned int height = 0;
+		std::vector<float> pixels;
+	};
+
+	// Six RGB float faces in GL_TEXTURE_CUBE_MAP_POSITIVE_X + i order
+	struct Cubemap {
+		unsigned int size = 0;
+		std::vector<float> texels;
+
+		const float* Face(unsigned int face) const { return texels.data() + static_cast<size_t>(face) * size * size * 3; }
+		float* Face(unsigned int face) { return texels.data() + static_cast<size_t>(face) * size * size * 3; }
+	};
+
+	bool LoadHDR(const std::string& path, Image& image);
+
+	Cubemap CubemapFromEquirectangular(const Image& equirectangular, unsigned int size);
+	Cubemap CreateIrradianceMap(const Cubemap& env_cubemap, unsigned int size);
+	// One cubemap per mip level, roughness goes from 0 to 1 across the chain
+	std::vector<Cubemap> CreatePrefilterMap(const Cubemap& env_cubemap, unsigned int size, unsigned int mip_levels, unsigned int sample_count);
+	// Interleaved RG floats, x is NdotV and y is roughness
+	std::vector<float> CreateBRDFLookup(unsigned int size, unsigned int sample_count);
+	// Projects the environment onto 9 SH coefficients and convolves them with the cosine lobe.
+	// Evaluating them in pbr.frag gives the same value the irradiance cubemap stores.
+	std::array<glm::vec3, 9> ProjectIrradianceSH(const Cubemap& env_cubemap);
+
+	CachedTexture ToCachedTexture(const std::vector<Cubemap>& mips);
+	CachedTexture ToCachedTexture(const std::vector<float>& brdf_lut, unsigned int size);
+	CachedTexture ToCachedTexture(const std::array<glm::vec3, 9>& irradiance_sh);
+
+	// Runs every environment dependent pass and returns the textures in the order Ibl::ReadbackMaps writes them.
+	// The BRDF LUT is not part of it, it is embedded in the renderer (see tools/BrdfLutGen.cpp).
+	bool Bake(const std::string& hdr_path, const Ibl::BakeSettings& settings, std::vector<CachedTexture>& textures);
+}
@@ -0,0 +1,241 @@
+#include "IblCache.h"
+
+#include <glad/glad.h>
+
+#include "Hash.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+
+namespace {
+	const char* kCacheDirectory = "cache/ibl";
+	const uint32_t kMagic = 0x434C4249; // "IBLC"
+	const uint32_t kVersion = 3;
+
+	struct FileHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key;
+		uint32_t texture_count;
+		uint32_t reserved;
+	};
+
+	struct TextureHeader {
+		uint32_t target;
+		uint32_t internal_format;
+		uint32_t format;
+		uint32_t type;
+		uint32_t width;
+		uint32_t height;
+		uint32_t mip_levels;
+		uint32_t faces;
+	};
+
+	// Bounds on what a valid entry can hold, anything beyond them is corrupt
+	const uint32_t kMaxTextures = 16;
+	const uint32_t kMaxSize = 16384;
+	const uint32_t kMaxMipLevels = 15;
+
+	std::mutex stats_mutex;
+	IblCache::Stats stats;
+
+	// Bytes of one image of `info` at `mip`, 0 for a format or type a bake never writes
+	size_t ImageBytes(const TextureHeader& info, uint32_t mip)
+	{
+		size_t components = 0;
+		switch (info.format) {
+		case GL_RED: components = 1; break;
+		case GL_RG: components = 2; break;
+		case GL_RGB: components = 3; break;
+		case GL_RGBA: components = 4; break;
+		default: return 0;
+		}
+		size_t component_bytes = 0;
+		switch (info.type) {
+		case GL_UNSIGNED_BYTE: component_bytes = 1; break;
+		case GL_HALF_FLOAT: component_bytes = 2; break;
+		case GL_FLOAT: component_bytes = 4; break;
+		default: return 0;
+		}
+		return static_cast<size_t>(std::max(1u, info.width >> mip)) * std::max(1u, info.height >> mip) * components * component_bytes;
+	}
+
+	bool ValidHeader(const TextureHeader& info)
+	{
+		if (info.width == 0 || info.height == 0 || info.width > kMaxSize || info.height > kMaxSize ||
+			(info.faces != 1 && info.faces != 6) || info.mip_levels == 0 || info.mip_levels > kMaxMipLevels) {
+			return false;
+		}
+		// No levels below 1x1
+		uint32_t largest = std::max(info.width, info.height);
+		return (largest >> (info.mip_levels - 1)) > 0 && ImageBytes(info, 0) > 0;
+	}
+
+	bool LoadEntry(uint64_t key, std::vector<CachedTexture>& textures)
+	{
+		std::ifstream file(IblCache::PathForKey(key), std::ios::binary);
+		if (!file) {
+			return false;
+		}
+
+		FileHeader header{};
+		file.read(reinterpret_cast<char*>(&header), sizeof(header));
+		if (!file || header.magic != kMagic || header.version != kVersion || header.key != key || header.texture_count > kMaxTextures) {
+			std::cout << "WARNING::IBL_CACHE::STALE_OR_CORRUPT_ENTRY " << IblCache::PathForKey(key) << std::endl;
+			return false;
+		}
+
+		textures.resize(header.texture_count);
+		for (CachedTexture& texture : textures) {
+			TextureHeader info{};
+			file.read(reinterpret_cast<char*>(&info), sizeof(info));
+			if (!file || !ValidHeader(info)) {
+				std::cout << "WARNING::IBL_CACHE::STALE_OR_CORRUPT_ENTRY " << IblCache::PathForKey(key) << std::endl;
+				return false;
+			}
+
+			texture.target = info.target;
+			texture.internal_format = info.internal_format;
+			texture.format = info.format;
+			texture.type = info.type;
+			texture.width = info.width;
+			texture.height = info.height;
+			texture.mip_levels = info.mip_levels;
+			texture.faces = info.faces;
+			texture.images.resize(static_cast<size_t>(info.mip_levels) * info.faces);
+
+			// Every image has to be exactly what the upload will read for its level
+			for (uint32_t mip = 0; mip < info.mip_levels; ++mip) {
+				size_t expected = ImageBytes(info, mip);
+				for (uint32_t face = 0; face < info.faces; ++face) {
+					std::vector<unsigned char>& image = texture.images[mip * info.faces + face];
+					uint32_t size = 0;
+					file.read(reinterpret_cast<char*>(&size), sizeof(size));
+					if (!file || size != expected) {
+						std::cout << "WARNING::IBL_CACHE::STALE_OR_CORRUPT_ENTRY " << IblCache::PathForKey(key) << std::endl;
+						return false;
+					}
+					image.resize(size);
+					file.read(reinterpret_cast<char*>(image.data()), size);
+					if (!file) {
+						std::cout << "WARNING::IBL_CACHE::STALE_OR_CORRUPT_ENTRY " << IblCache::PathForKey(key) << std::endl;
+						return false;
+					}
+				}
+			}
+		}
+		return true;
+	}
+}
+
+uint64_t IblCache::ComputeKey(const std::string& hdr_path, const Ibl::BakeSettings& settings)
+{
+	uint64_t hash = Hash::HashFile(hdr_path);
+	if (hash == 0) {
+		return 0;
+	}
+
+	const uint32_t params[] = {
+		kVersion,
+		settings.env_size,
+		settings.irradiance_size,
+		settings.prefilter_size,
+		settings.prefilter_mips,
+		settings.sample_count,
+		settings.sh_irradiance ? 1u : 0u,
+		// Keep separate entries per backend so switching it rebakes and the bake times can be compared
+		static_cast<uint32_t>(settings.backend),
+	};
+	return Hash::Fnv1a64(params, sizeof(params), hash);
+}
+
+std::string IblCache::PathForKey(uint64_t key)
+{
+	return std::string(kCacheDirectory) + "/" + Hash::ToHex(key) + ".iblc";
+}
+
+bool IblCache::Load(uint64_t key, std::vector<CachedTexture>& textures)
+{
+	auto start = std::chrono::steady_clock::now();
+	textures.clear();
+	bool hit = LoadEntry(key, textures);
+	if (!hit) {
+		textures.clear();
+	}
+
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	if (hit) {
+		stats.hits++;
+		stats.load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+	else {
+		stats.misses++;
+	}
+	return hit;
+}
+
+bool IblCache::Store(uint64_t key, const std::vector<CachedTexture>& textures)
+{
+	std::error_code error;
+	std::filesystem::create_directories(kCacheDirectory, error);
+
+	// Write to a temporary file first so an interrupted bake never leaves a truncated entry behind
+	std::string path = PathForKey(key);
+	std::string temp_path = path + ".tmp";
+	{
+		std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+		if (!file) {
+			std::cout << "ERROR::IBL_CACHE::FAILED_TO_OPEN " << temp_path << std::endl;
+			return false;
+		}
+
+		FileHeader header{ kMagic, kVersion, key, static_cast<uint32_t>(textures.size()), 0 };
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		for (const CachedTexture& texture : textures) {
+			TextureHeader info{ texture.target, texture.internal_format, texture.format, texture.type,
+				texture.width, texture.height, texture.mip_levels, texture.faces };
+			file.write(reinterpret_cast<const char*>(&info), sizeof(info));
+
+			for (const std::vector<unsigned char>& image : texture.images) {
+				uint32_t size = static_cast<uint32_t>(image.size());
+				file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+				file.write(reinterpret_cast<const char*>(image.data()), size);
+			}
+		}
+
+		if (!file) {
+			std::cout << "ERROR::IBL_CACHE::FAILED_TO_WRITE " << temp_path << std::endl;
+			return false;
+		}
+	}
+
+	std::filesystem::rename(temp_path, path, error);
+	return !error;
+}
+
+void IblCache::RecordBake(double milliseconds)
+{
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	stats.bake_ms = milliseconds;
+}
+
+IblCache::Stats IblCache::GetStats()
+{
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	return stats;
+}
+
+std::string IblCache::Report()
+{
+	Stats current = GetStats();
+	std::ostringstream report;
+	report << "IBL cache: " << current.hits << " hits, " << current.misses << " misses, last load " << current.load_ms
+		<< " ms, last bake " << current.bake_ms << " ms";
+	return report.str();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Ibl.h"
+
+// A baked IBL texture with every face and mip level kept in CPU memory.
+// GL enums are stored as plain integers so the cache can be written without a context.
+struct CachedTexture {
+	unsigned int target = 0;
+	unsigned int internal_format = 0;
+	unsigned int format = 0;
+	unsigned int type = 0;
+	unsigned int width = 0;
+	unsigned int height = 0;
+	unsigned int mip_levels = 1;
+	unsigned int faces = 1;
+	// Indexed by mip * faces + face
+	std::vector<std::vector<unsigned char>> images;
+};
+
+// On-disk cache of baked IBL textures keyed by the HDR contents and the bake settings
+namespace IblCache {
+	// Lookups since startup and the time of the last load and bake
+	struct Stats {
+		unsigned int hits = 0;
+		unsigned int misses = 0;
+		double load_ms = 0.0;
+		double bake_ms = 0.0;
+	};
+
+	// Returns 0 if the source file can't be read
+	uint64_t ComputeKey(const std::string& hdr_path, const Ibl::BakeSettings& settings);
+	std::string PathForKey(uint64_t key);
+
+	// A missing, stale or malformed entry is a miss and leaves `textures` empty. Safe to call from any thread.
+	bool Load(uint64_t key, std::vector<CachedTexture>& textures);
+	bool Store(uint64_t key, const std::vector<CachedTexture>& textures);
+
+	// Time of a bake that ran because of a miss, the baker reports it
+	void RecordBake(double milliseconds);
+	Stats GetStats();
+	std::string Report();
+}
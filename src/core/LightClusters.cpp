@@ -0,0 +1,161 @@
+#include "LightClusters.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include "../opengl/StreamBuffer.h"
+
+void LightClusters::Build(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+	float near_plane, float far_plane, int width, int height)
+{
+	width = std::max(width, 1);
+	height = std::max(height, 1);
+	tile_size_ = glm::vec2(std::ceil(static_cast<float>(width) / kTilesX), std::ceil(static_cast<float>(height) / kTilesY));
+
+	// slice = log(depth) * scale + bias puts kSlices exponential slices between the planes, so froxels stay
+	// roughly cubic instead of getting long and thin far away
+	float log_ratio = std::log(far_plane / near_plane);
+	slice_scale_ = static_cast<float>(kSlices) / log_ratio;
+	slice_bias_ = -slice_scale_ * std::log(near_plane);
+	for (unsigned int s = 0; s <= kSlices; ++s) {
+		slice_depths_[s] = near_plane * std::pow(far_plane / near_plane, static_cast<float>(s) / kSlices);
+	}
+
+	// A symmetric perspective projection maps x / depth to NDC with a single scale
+	float scale_x = projection[0][0];
+	float scale_y = projection[1][1];
+	for (unsigned int x = 0; x <= kTilesX; ++x) {
+		tile_slopes_x_[x] = (2.0f * x * tile_size_.x / width - 1.0f) / scale_x;
+	}
+	for (unsigned int y = 0; y <= kTilesY; ++y) {
+		tile_slopes_y_[y] = (2.0f * y * tile_size_.y / height - 1.0f) / scale_y;
+	}
+	auto tile = [](float slope, float scale, float size, float pixels, unsigned int tiles) {
+		float pixel = (slope * scale + 1.0f) * 0.5f * pixels;
+		return static_cast<unsigned int>(glm::clamp(std::floor(pixel / size), 0.0f, static_cast<float>(tiles - 1)));
+	};
+
+	light_count_ = lights.size();
+	lights_.resize(std::max<size_t>(lights.size(), 1));
+	assignments_.clear();
+	for (size_t i = 0; i < lights.size(); ++i) {
+		const PointLight& light = lights[i];
+		float range = std::max(light.range, 0.0001f);
+		lights_[i].position_inv_sqr_range = glm::vec4(light.position, 1.0f / (range * range));
+		lights_[i].color = glm::vec4(light.color, 1.0f);
+
+		glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+		float depth = -center.z;
+		if (depth + range < near_plane || depth - range > far_plane) {
+			continue;
+		}
+		float near_depth = std::max(depth - range, near_plane);
+		float far_depth = std::min(depth + range, far_plane);
+
+		// Screen bounds of the sphere's view space box: x / depth is extreme at its corners, the nearest
+		// depth widens a side that is off the axis and the farthest one a side that crosses it
+		float min_x = center.x - range, max_x = center.x + range;
+		float min_y = center.y - range, max_y = center.y + range;
+		float min_slope_x = min_x / (min_x < 0.0f ? near_depth : far_depth);
+		float max_slope_x = max_x / (max_x > 0.0f ? near_depth : far_depth);
+		float min_slope_y = min_y / (min_y < 0.0f ? near_depth : far_depth);
+		float max_slope_y = max_y / (max_y > 0.0f ? near_depth : far_depth);
+		if (max_slope_x * scale_x < -1.0f || min_slope_x * scale_x > 1.0f ||
+			max_slope_y * scale_y < -1.0f || min_slope_y * scale_y > 1.0f) {
+			continue;
+		}
+
+		unsigned int first_x = tile(min_slope_x, scale_x, tile_size_.x, static_cast<float>(width), kTilesX);
+		unsigned int last_x = tile(max_slope_x, scale_x, tile_size_.x, static_cast<float>(width), kTilesX);
+		unsigned int first_y = tile(min_slope_y, scale_y, tile_size_.y, static_cast<float>(height), kTilesY);
+		unsigned int last_y = tile(max_slope_y, scale_y, tile_size_.y, static_cast<float>(height), kTilesY);
+		unsigned int first_slice = Slice(near_depth);
+		unsigned int last_slice = Slice(far_depth);
+
+		// The box is loose around the sphere's silhouette, each froxel's view space bounds are tested too
+		float range_squared = range * range;
+		for (unsigned int s = first_slice; s <= last_slice; ++s) {
+			float d0 = slice_depths_[s], d1 = slice_depths_[s + 1];
+			float dz = std::max(std::max(d0 - depth, 0.0f), depth - d1);
+			for (unsigned int y = first_y; y <= last_y; ++y) {
+				float y0 = std::min(tile_slopes_y_[y] * d0, tile_slopes_y_[y] * d1);
+				float y1 = std::max(tile_slopes_y_[y + 1] * d0, tile_slopes_y_[y + 1] * d1);
+				float dy = std::max(std::max(y0 - center.y, 0.0f), center.y - y1);
+				for (unsigned int x = first_x; x <= last_x; ++x) {
+					float x0 = std::min(tile_slopes_x_[x] * d0, tile_slopes_x_[x] * d1);
+					float x1 = std::max(tile_slopes_x_[x + 1] * d0, tile_slopes_x_[x + 1] * d1);
+					float dx = std::max(std::max(x0 - center.x, 0.0f), center.x - x1);
+					if (dx * dx + dy * dy + dz * dz <= range_squared) {
+						assignments_.push_back({ (s * kTilesY + y) * kTilesX + x, static_cast<unsigned int>(i) });
+					}
+				}
+			}
+		}
+	}
+
+	// Counting sort by froxel, the lights of one froxel end up consecutive in the index buffer
+	clusters_.assign(kClusterCount, { 0, 0 });
+	for (const Assignment& assignment : assignments_) {
+		clusters_[assignment.cluster].count++;
+	}
+	unsigned int offset = 0;
+	max_cluster_lights_ = 0;
+	for (ClusterData& cluster : clusters_) {
+		cluster.offset = offset;
+		offset += cluster.count;
+		max_cluster_lights_ = std::max(max_cluster_lights_, cluster.count);
+	}
+	// Never empty, a zero sized range can't be bound
+	indices_.resize(std::max<size_t>(assignments_.size(), 1));
+	std::vector<unsigned int> cursor(kClusterCount);
+	for (unsigned int c = 0; c < kClusterCount; ++c) {
+		cursor[c] = clusters_[c].offset;
+	}
+	for (const Assignment& assignment : assignments_) {
+		indices_[cursor[assignment.cluster]++] = assignment.light;
+	}
+}
+
+void LightClusters::Upload(StreamBuffer& stream)
+{
+	size_t light_bytes = lights_.size() * sizeof(LightData);
+	size_t cluster_bytes = clusters_.size() * sizeof(ClusterData);
+	size_t index_bytes = indices_.size() * sizeof(unsigned int);
+	if (cluster_bytes == 0) {
+		return;
+	}
+	stream.Reserve(light_bytes + cluster_bytes + index_bytes, 3);
+	size_t light_offset = stream.Write(lights_.data(), light_bytes);
+	size_t cluster_offset = stream.Write(clusters_.data(), cluster_bytes);
+	size_t index_offset = stream.Write(indices_.data(), index_bytes);
+	stream.BindRange(GL_SHADER_STORAGE_BUFFER, kLightBinding, light_offset, light_bytes);
+	stream.BindRange(GL_SHADER_STORAGE_BUFFER, kClusterBinding, cluster_offset, cluster_bytes);
+	stream.BindRange(GL_SHADER_STORAGE_BUFFER, kIndexBinding, index_offset, index_bytes);
+}
+
+glm::uvec4 LightClusters::GridSize() const
+{
+	return glm::uvec4(kTilesX, kTilesY, kSlices, static_cast<unsigned int>(light_count_));
+}
+
+glm::vec4 LightClusters::GridParams() const
+{
+	return glm::vec4(tile_size_, slice_scale_, slice_bias_);
+}
+
+std::string LightClusters::Report() const
+{
+	std::ostringstream report;
+	report << "Lights: " << light_count_ << ", " << assignments_.size() << " froxel entries (at most " << max_cluster_lights_
+		<< " in one of " << kClusterCount << ")";
+	return report.str();
+}
+
+unsigned int LightClusters::Slice(float depth) const
+{
+	float slice = std::floor(std::log(depth) * slice_scale_ + slice_bias_);
+	return static_cast<unsigned int>(glm::clamp(slice, 0.0f, static_cast<float>(kSlices - 1)));
+}
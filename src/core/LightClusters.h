@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+class StreamBuffer;
+
+// Clustered forward light culling. The view frustum is split into froxels, screen tiles times exponentially
+// spaced depth slices, and every froxel gets the list of point lights whose range reaches it. pbr.frag finds
+// its froxel from gl_FragCoord and the view depth (see common/clusters.glsl) and only shades those lights, so
+// the cost of a pixel follows the lights around it rather than the number of lights in the scene.
+// The grid is rebuilt on the CPU every frame and written into the StreamBuffer as three storage buffers.
+class LightClusters
+{
+public:
+	static const unsigned int kLightBinding = 2;
+	static const unsigned int kClusterBinding = 3;
+	static const unsigned int kIndexBinding = 4;
+	static const unsigned int kTilesX = 16;
+	static const unsigned int kTilesY = 9;
+	static const unsigned int kSlices = 24;
+
+	struct PointLight {
+		glm::vec3 position = glm::vec3(0.0f);
+		// Radiant intensity, falls off with the squared distance
+		glm::vec3 color = glm::vec3(1.0f);
+		// Distance at which the light is faded out completely, see smoothDistanceAtt in pbr.frag
+		float range = 1.0f;
+	};
+
+	// Assigns `lights` to the froxels of the camera. The planes have to be the ones of `projection`, `width` and
+	// `height` are the viewport in pixels.
+	void Build(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+		float near_plane, float far_plane, int width, int height);
+	// Writes the light, cluster and index buffers of the last Build and binds them
+	void Upload(StreamBuffer& stream);
+
+	// Tiles in x and y, depth slices and light count, for the Frame block
+	glm::uvec4 GridSize() const;
+	// Tile size in pixels, depth slice scale and bias
+	glm::vec4 GridParams() const;
+
+	// Lights and froxel entries of the last Build
+	std::string Report() const;
+
+private:
+	static const unsigned int kClusterCount = kTilesX * kTilesY * kSlices;
+
+	// Layouts as seen by the shaders (std430)
+	struct LightData {
+		// xyz position, w 1 / range^2
+		glm::vec4 position_inv_sqr_range;
+		glm::vec4 color;
+	};
+	struct ClusterData {
+		// First entry in the index buffer and light count
+		unsigned int offset;
+		unsigned int count;
+	};
+	struct Assignment {
+		unsigned int cluster;
+		unsigned int light;
+	};
+
+	glm::vec2 tile_size_ = glm::vec2(1.0f);
+	float slice_scale_ = 0.0f;
+	float slice_bias_ = 0.0f;
+	size_t light_count_ = 0;
+	unsigned int max_cluster_lights_ = 0;
+
+	// View depth of the slice boundaries and x/depth, y/depth of the tile boundaries
+	float slice_depths_[kSlices + 1] = {};
+	float tile_slopes_x_[kTilesX + 1] = {};
+	float tile_slopes_y_[kTilesY + 1] = {};
+
+	std::vector<LightData> lights_;
+	std::vector<Assignment> assignments_;
+	std::vector<ClusterData> clusters_;
+	std::vector<unsigned int> indices_;
+
+	unsigned int Slice(float depth) const;
+};
@@ -0,0 +1,549 @@
+#include "Model.h"
+
+#include <glad/glad.h>
+#include <tiny_gltf.h>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <map>
+
+#include "Parallel.h"
+#include "PbrFeatures.h"
+#include "RenderQueue.h"
+
+namespace {
+	// Interleaved position, normal, uv
+	const unsigned int kVertexFloats = 8;
+
+	using EncodedImage = std::shared_ptr<const std::vector<unsigned char>>;
+
+	// Keeps the encoded bytes instead of decoding them, the TextureStreamer decodes them on its pool
+	bool StoreEncodedImage(tinygltf::Image* /*image*/, const int image_idx, std::string* /*err*/, std::string* /*warn*/,
+		int /*req_width*/, int /*req_height*/, const unsigned char* bytes, int size, void* user_data)
+	{
+		std::vector<EncodedImage>& images = *static_cast<std::vector<EncodedImage>*>(user_data);
+		if (images.size() <= static_cast<size_t>(image_idx)) {
+			images.resize(image_idx + 1);
+		}
+		images[image_idx] = std::make_shared<const std::vector<unsigned char>>(bytes, bytes + size);
+		return true;
+	}
+
+	// Whether the accessor's elements of `element_size` bytes lie inside its buffer view and the view inside its
+	// buffer, so a malformed file is rejected instead of read out of bounds
+	bool AccessorInBounds(const tinygltf::Model& gltf, const tinygltf::Accessor& accessor, size_t element_size)
+	{
+		if (accessor.bufferView < 0 || accessor.bufferView >= static_cast<int>(gltf.bufferViews.size())) {
+			return false;
+		}
+		const tinygltf::BufferView& view = gltf.bufferViews[accessor.bufferView];
+		if (view.buffer < 0 || view.buffer >= static_cast<int>(gltf.buffers.size()) ||
+			view.byteOffset > gltf.buffers[view.buffer].data.size() ||
+			view.byteLength > gltf.buffers[view.buffer].data.size() - view.byteOffset) {
+			return false;
+		}
+		int stride = accessor.ByteStride(view);
+		if (stride <= 0 || accessor.count > view.byteLength) {
+			return false;
+		}
+		return accessor.count == 0 ||
+			accessor.byteOffset + (accessor.count - 1) * static_cast<size_t>(stride) + element_size <= view.byteLength;
+	}
+
+	// Reads `components` values of each of the accessor's `count` elements into `out`, `out_stride` floats apart.
+	// Normalized integers are mapped to 0..1 (-1..1 when signed), unnormalized ones are converted as they are.
+	bool ReadFloats(const tinygltf::Model& gltf, int accessor_index, size_t count, unsigned int components, float* out, size_t out_stride)
+	{
+		if (accessor_index < 0 || accessor_index >= static_cast<int>(gltf.accessors.size())) {
+			return false;
+		}
+		const tinygltf::Accessor& accessor = gltf.accessors[accessor_index];
+		int component_size = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+		if (accessor.count != count || component_size <= 0 || tinygltf::GetNumComponentsInType(accessor.type) < static_cast<int>(components) ||
+			!AccessorInBounds(gltf, accessor, components * static_cast<size_t>(component_size))) {
+			return false;
+		}
+		const tinygltf::BufferView& view = gltf.bufferViews[accessor.bufferView];
+		const unsigned char* data = gltf.buffers[view.buffer].data.data() + view.byteOffset + accessor.byteOffset;
+		int stride = accessor.ByteStride(view);
+
+		for (size_t i = 0; i < accessor.count; ++i) {
+			const unsigned char* element = data + i * stride;
+			float* dst = out + i * out_stride;
+			for (unsigned int c = 0; c < components; ++c) {
+				switch (accessor.componentType)
+				{
+				case TINYGLTF_COMPONENT_TYPE_FLOAT:
+					std::memcpy(&dst[c], element + c * sizeof(float), sizeof(float));
+					break;
+				case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+					dst[c] = element[c] / (accessor.normalized ? 255.0f : 1.0f);
+					break;
+				case TINYGLTF_COMPONENT_TYPE_BYTE:
+					dst[c] = accessor.normalized ? std::max(static_cast<signed char>(element[c]) / 127.0f, -1.0f) : static_cast<signed char>(element[c]);
+					break;
+				case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+					unsigned short value;
+					std::memcpy(&value, element + c * sizeof(value), sizeof(value));
+					dst[c] = value / (accessor.normalized ? 65535.0f : 1.0f);
+					break;
+				}
+				case TINYGLTF_COMPONENT_TYPE_SHORT: {
+					short value;
+					std::memcpy(&value, element + c * sizeof(value), sizeof(value));
+					dst[c] = accessor.normalized ? std::max(value / 32767.0f, -1.0f) : value;
+					break;
+				}
+				default:
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Reads the accessor's `count` indices, each has to be below `vertex_count`
+	bool ReadIndices(const tinygltf::Model& gltf, int accessor_index, size_t count, size_t vertex_count, unsigned int* out)
+	{
+		if (accessor_index < 0 || accessor_index >= static_cast<int>(gltf.accessors.size())) {
+			return false;
+		}
+		const tinygltf::Accessor& accessor = gltf.accessors[accessor_index];
+		int component_size = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+		if (accessor.count != count || component_size <= 0 || !AccessorInBounds(gltf, accessor, static_cast<size_t>(component_size))) {
+			return false;
+		}
+		const tinygltf::BufferView& view = gltf.bufferViews[accessor.bufferView];
+		const unsigned char* data = gltf.buffers[view.buffer].data.data() + view.byteOffset + accessor.byteOffset;
+		int stride = accessor.ByteStride(view);
+
+		for (size_t i = 0; i < accessor.count; ++i) {
+			const unsigned char* element = data + i * stride;
+			switch (accessor.componentType)
+			{
+			case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+				out[i] = element[0];
+				break;
+			case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+				unsigned short value;
+				std::memcpy(&value, element, sizeof(value));
+				out[i] = value;
+				break;
+			}
+			case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+				std::memcpy(&out[i], element, sizeof(unsigned int));
+				break;
+			default:
+				return false;
+			}
+			if (out[i] >= vertex_count) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	glm::mat4 NodeTransform(const tinygltf::Node& node)
+	{
+		if (node.matrix.size() == 16) {
+			return glm::mat4(glm::make_mat4(node.matrix.data()));
+		}
+
+		glm::mat4 transform(1.0f);
+		if (node.translation.size() == 3) {
+			transform = glm::translate(transform, glm::vec3(glm::make_vec3(node.translation.data())));
+		}
+		if (node.rotation.size() == 4) {
+			// glTF stores quaternions as x, y, z, w
+			transform *= glm::mat4_cast(glm::quat(static_cast<float>(node.rotation[3]), static_cast<float>(node.rotation[0]),
+				static_cast<float>(node.rotation[1]), static_cast<float>(node.rotation[2])));
+		}
+		if (node.scale.size() == 3) {
+			transform = glm::scale(transform, glm::vec3(glm::make_vec3(node.scale.data())));
+		}
+		return transform;
+	}
+
+	int TextureImage(const tinygltf::Model& gltf, int texture_index)
+	{
+		if (texture_index < 0 || texture_index >= static_cast<int>(gltf.textures.size())) {
+			return -1;
+		}
+		int source = gltf.textures[texture_index].source;
+		return source < static_cast<int>(gltf.images.size()) ? source : -1;
+	}
+
+	std::string ImageName(const tinygltf::Model& gltf, int image_index)
+	{
+		const tinygltf::Image& image = gltf.images[image_index];
+		if (!image.uri.empty() && image.uri.compare(0, 5, "data:") != 0) {
+			return image.uri;
+		}
+		return image.name.empty() ? "image" + std::to_string(image_index) : image.name;
+	}
+}
+
+Model::Model(const std::string& path, TextureStreamer& streamer, BufferArena& arena)
+	: streamer_(streamer), arena_(arena)
+{
+	tinygltf::TinyGLTF loader;
+	tinygltf::Model gltf;
+	std::string error, warning;
+	std::vector<EncodedImage> images;
+	loader.SetImageLoader(StoreEncodedImage, &images);
+
+	bool binary = path.size() > 4 && path.compare(path.size() - 4, 4, ".glb") == 0;
+	bool success = binary ? loader.LoadBinaryFromFile(&gltf, &error, &warning, path)
+		: loader.LoadASCIIFromFile(&gltf, &error, &warning, path);
+	if (!warning.empty()) {
+		std::cout << "WARNING::MODEL::" << warning << std::endl;
+	}
+	if (!success) {
+		std::cout << "ERROR::MODEL::FAILED_TO_LOAD " << path << "\n" << error << std::endl;
+		return;
+	}
+	images.resize(gltf.images.size());
+
+	// Materials, every image is handed to the streamer once however many materials share it
+	std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+	std::map<int, TextureStreamer::Handle> image_textures;
+	std::map<std::pair<int, int>, TextureStreamer::Handle> orm_textures;
+	auto load_image = [&](int image) {
+		if (image < 0 || !images[image]) {
+			return Material::kNoTexture;
+		}
+		auto found = image_textures.find(image);
+		if (found != image_textures.end()) {
+			return found->second;
+		}
+		TextureStreamer::Handle handle = streamer_.LoadEncoded(ImageName(gltf, image), images[image], false);
+		image_textures[image] = handle;
+		texture_count_++;
+		return handle;
+	};
+
+	for (const tinygltf::Material& source : gltf.materials) {
+		Material material;
+		const tinygltf::PbrMetallicRoughness& pbr = source.pbrMetallicRoughness;
+		if (pbr.baseColorFactor.size() == 4) {
+			material.base_color_factor = glm::vec4(glm::make_vec4(pbr.baseColorFactor.data()));
+		}
+		material.metallic_factor = static_cast<float>(pbr.metallicFactor);
+		material.roughness_factor = static_cast<float>(pbr.roughnessFactor);
+		material.double_sided = source.doubleSided;
+		material.albedo = load_image(TextureImage(gltf, pbr.baseColorTexture.index));
+		material.normal = load_image(TextureImage(gltf, source.normalTexture.index));
+
+		// glTF keeps roughness in G and metallic in B like our ORM layout, occlusion is R of its own map.
+		// Only when occlusion lives in the same image is it already packed: R of a metallic-roughness image is
+		// undefined otherwise, and often 0. Everything else is packed while decoding, a missing map with glTF's
+		// neutral value 1 so its factor alone decides.
+		int occlusion = TextureImage(gltf, source.occlusionTexture.index);
+		int metallic_roughness = TextureImage(gltf, pbr.metallicRoughnessTexture.index);
+		if (occlusion >= 0 && !images[occlusion]) {
+			occlusion = -1;
+		}
+		if (metallic_roughness >= 0 && !images[metallic_roughness]) {
+			metallic_roughness = -1;
+		}
+		if (occlusion == metallic_roughness) {
+			material.orm = load_image(metallic_roughness);
+		}
+		else {
+			std::pair<int, int> key(occlusion, metallic_roughness);
+			auto found = orm_textures.find(key);
+			if (found != orm_textures.end()) {
+				material.orm = found->second;
+			}
+			else {
+				std::string name = ImageName(gltf, metallic_roughness >= 0 ? metallic_roughness : occlusion);
+				TextureStreamer::Source ambient_occlusion, roughness, metallic;
+				if (occlusion >= 0) {
+					ambient_occlusion = TextureStreamer::Source(images[occlusion], 0);
+				}
+				if (metallic_roughness >= 0) {
+					roughness = TextureStreamer::Source(images[metallic_roughness], 1);
+					metallic = TextureStreamer::Source(images[metallic_roughness], 2);
+				}
+				ambient_occlusion.neutral = roughness.neutral = metallic.neutral = 255;
+				material.orm = streamer_.LoadOrm(directory + name.substr(0, name.find_last_of('.')) + "_orm.btex",
+					ambient_occlusion, roughness, metallic, false);
+				orm_textures[key] = material.orm;
+				texture_count_++;
+			}
+		}
+		materials_.push_back(material);
+	}
+
+	// First pass: place every primitive in the shared buffers
+	struct Job {
+		const tinygltf::Primitive* source;
+		Primitive* primitive;
+		size_t vertex_count;
+		size_t first_vertex;
+	};
+	std::vector<Job> jobs;
+	size_t vertex_total = 0;
+	size_t index_total = 0;
+	bool skipped = false;
+	meshes_.resize(gltf.meshes.size());
+	for (size_t m = 0; m < gltf.meshes.size(); ++m) {
+		meshes_[m].name = gltf.meshes[m].name;
+		for (const tinygltf::Primitive& source : gltf.meshes[m].primitives) {
+			auto position = source.attributes.find("POSITION");
+			if (source.mode != TINYGLTF_MODE_TRIANGLES || position == source.attributes.end()) {
+				skipped = true;
+				continue;
+			}
+			if (position->second < 0 || position->second >= static_cast<int>(gltf.accessors.size()) ||
+				source.indices >= static_cast<int>(gltf.accessors.size())) {
+				std::cout << "ERROR::MODEL::INVALID_ACCESSOR " << path << " mesh " << m << std::endl;
+				continue;
+			}
+
+			size_t vertex_count = gltf.accessors[position->second].count;
+			size_t index_count = source.indices >= 0 ? gltf.accessors[source.indices].count : vertex_count;
+			Primitive primitive;
+			primitive.first_index = static_cast<unsigned int>(index_total);
+			primitive.index_count = static_cast<unsigned int>(index_count);
+			primitive.base_vertex = static_cast<int>(vertex_total);
+			primitive.material = source.material;
+			meshes_[m].primitives.push_back(primitive);
+			jobs.push_back({ &source, nullptr, vertex_count, vertex_total });
+
+			vertex_total += vertex_count;
+			index_total += index_count;
+		}
+	}
+	if (skipped) {
+		std::cout << "WARNING::MODEL::SKIPPED_NON_TRIANGLE_PRIMITIVES " << path << std::endl;
+	}
+	if (vertex_total == 0 || index_total == 0) {
+		std::cout << "ERROR::MODEL::NO_TRIANGLES " << path << std::endl;
+		return;
+	}
+
+	// The primitive vectors don't grow anymore, point the jobs at their primitives
+	size_t job = 0;
+	for (Mesh& mesh : meshes_) {
+		for (Primitive& primitive : mesh.primitives) {
+			jobs[job++].primitive = &primitive;
+		}
+	}
+
+	// Second pass: convert the attributes of all primitives in parallel, straight into the shared arrays
+	if (arena_.VertexStride() != kVertexFloats * sizeof(float)) {
+		std::cout << "ERROR::MODEL::ARENA_LAYOUT_MISMATCH " << path << std::endl;
+		return;
+	}
+	std::vector<float> vertices(vertex_total * kVertexFloats, 0.0f);
+	std::vector<unsigned int> indices(index_total);
+	// Every accessor is checked against its buffer and every index against the primitive's vertices, a primitive
+	// that fails is dropped. Reads stay inside the primitive's own range of the arrays either way.
+	std::vector<unsigned char> rejected(jobs.size(), 0);
+	Parallel::For(0, jobs.size(), [&](size_t i) {
+		const Job& job = jobs[i];
+		const tinygltf::Primitive& source = *job.source;
+		Primitive& primitive = *job.primitive;
+		float* vertex = vertices.data() + job.first_vertex * kVertexFloats;
+		unsigned int* index = indices.data() + primitive.first_index;
+
+		if (!ReadFloats(gltf, source.attributes.at("POSITION"), job.vertex_count, 3, vertex, kVertexFloats)) {
+			rejected[i] = 1;
+			return;
+		}
+		auto texcoord = source.attributes.find("TEXCOORD_0");
+		if (texcoord != source.attributes.end()) {
+			ReadFloats(gltf, texcoord->second, job.vertex_count, 2, vertex + 6, kVertexFloats);
+		}
+		if (source.indices >= 0) {
+			if (!ReadIndices(gltf, source.indices, primitive.index_count, job.vertex_count, index)) {
+				rejected[i] = 1;
+				return;
+			}
+		}
+		else {
+			for (unsigned int j = 0; j < primitive.index_count; ++j) {
+				index[j] = j;
+			}
+		}
+
+		auto normal = source.attributes.find("NORMAL");
+		if (normal == source.attributes.end() || !ReadFloats(gltf, normal->second, job.vertex_count, 3, vertex + 3, kVertexFloats)) {
+			// Smooth normals from the area weighted face normals
+			for (unsigned int j = 0; j + 2 < primitive.index_count; j += 3) {
+				float* corners[3] = { vertex + index[j] * kVertexFloats, vertex + index[j + 1] * kVertexFloats, vertex + index[j + 2] * kVertexFloats };
+				glm::vec3 face = glm::cross(glm::make_vec3(corners[1]) - glm::make_vec3(corners[0]), glm::make_vec3(corners[2]) - glm::make_vec3(corners[0]));
+				for (float* corner : corners) {
+					corner[3] += face.x;
+					corner[4] += face.y;
+					corner[5] += face.z;
+				}
+			}
+			for (size_t v = 0; v < job.vertex_count; ++v) {
+				float* n = vertex + v * kVertexFloats + 3;
+				glm::vec3 sum = glm::make_vec3(n);
+				float length = glm::length(sum);
+				if (length > 0.0f) {
+					n[0] = sum.x / length;
+					n[1] = sum.y / length;
+					n[2] = sum.z / length;
+				}
+			}
+		}
+
+		primitive.bounds.min = glm::vec3(std::numeric_limits<float>::max());
+		primitive.bounds.max = glm::vec3(-std::numeric_limits<float>::max());
+		for (size_t v = 0; v < job.vertex_count; ++v) {
+			glm::vec3 position = glm::make_vec3(vertex + v * kVertexFloats);
+			primitive.bounds.min = glm::min(primitive.bounds.min, position);
+			primitive.bounds.max = glm::max(primitive.bounds.max, position);
+		}
+	});
+
+	// The rejected primitives keep their zeroed ranges in the arrays but are never drawn
+	size_t rejected_count = 0;
+	for (size_t i = 0; i < jobs.size(); ++i) {
+		if (rejected[i]) {
+			std::cout << "ERROR::MODEL::INVALID_PRIMITIVE_DATA " << path << " primitive " << i << std::endl;
+			std::fill(indices.begin() + jobs[i].primitive->first_index,
+				indices.begin() + jobs[i].primitive->first_index + jobs[i].primitive->index_count, 0u);
+			jobs[i].primitive->index_count = 0;
+			rejected_count++;
+		}
+		else {
+			triangle_count_ += jobs[i].primitive->index_count / 3;
+		}
+	}
+	for (Mesh& mesh : meshes_) {
+		mesh.primitives.erase(std::remove_if(mesh.primitives.begin(), mesh.primitives.end(),
+			[](const Primitive& primitive) { return primitive.index_count == 0; }), mesh.primitives.end());
+	}
+	if (rejected_count == jobs.size()) {
+		std::cout << "ERROR::MODEL::NO_TRIANGLES " << path << std::endl;
+		return;
+	}
+
+	// Mesh nodes of the default scene with their world transforms
+	std::vector<std::pair<int, glm::mat4>> stack;
+	if (gltf.scenes.empty()) {
+		for (size_t m = 0; m < meshes_.size(); ++m) {
+			nodes_.push_back({ glm::mat4(1.0f), static_cast<unsigned int>(m) });
+		}
+	}
+	else {
+		const tinygltf::Scene& scene = gltf.scenes[gltf.defaultScene >= 0 ? gltf.defaultScene : 0];
+		for (int root : scene.nodes) {
+			stack.emplace_back(root, glm::mat4(1.0f));
+		}
+	}
+	// glTF nodes form a forest, a node reached twice has two parents or is part of a cycle that would never end
+	std::vector<bool> visited(gltf.nodes.size(), false);
+	while (!stack.empty()) {
+		std::pair<int, glm::mat4> entry = stack.back();
+		stack.pop_back();
+		if (entry.first < 0 || entry.first >= static_cast<int>(gltf.nodes.size())) {
+			continue;
+		}
+		if (visited[entry.first]) {
+			std::cout << "ERROR::MODEL::NODE_REACHED_TWICE " << entry.first << " " << path << std::endl;
+			continue;
+		}
+		visited[entry.first] = true;
+		const tinygltf::Node& node = gltf.nodes[entry.first];
+		glm::mat4 transform = entry.second * NodeTransform(node);
+		if (node.mesh >= 0 && node.mesh < static_cast<int>(meshes_.size())) {
+			nodes_.push_back({ transform, static_cast<unsigned int>(node.mesh) });
+		}
+		for (int child : node.children) {
+			stack.emplace_back(child, transform);
+		}
+	}
+
+	// One range of the shared buffers for the whole model
+	allocation_ = arena_.Allocate(vertices.data(), static_cast<unsigned int>(vertex_total), indices.data(), static_cast<unsigned int>(index_total));
+
+	loaded_ = true;
+	std::cout << "MODEL::LOADED " << path << " (" << triangle_count_ << " triangles, " << jobs.size() - rejected_count << " primitives, "
+		<< texture_count_ << " textures)" << std::endl;
+}
+
+Model::~Model()
+{
+	if (loaded_) {
+		arena_.Free(allocation_);
+	}
+}
+
+bool Model::IsLoaded() const
+{
+	return loaded_;
+}
+
+void Model::Submit(RenderQueue& queue, const glm::mat4& transform) const
+{
+	if (!loaded_) {
+		return;
+	}
+
+	// Streamed textures change their GL names as they grow, so the materials are added every frame
+	std::vector<unsigned int> queued(materials_.size() + 1);
+	for (size_t i = 0; i <= materials_.size(); ++i) {
+		const Material& material = i < materials_.size() ? materials_[i] : Material();
+		const TextureStreamer::Handle textures[3] = { material.albedo, material.normal, material.orm };
+		RenderQueue::Material entry;
+		// A missing map, or one that isn't resident or failed to load, drops its flag. The variant without it uses
+		// the factors alone and leaves the slot unbound.
+		for (unsigned int t = 0; t < 3; ++t) {
+			if (textures[t] != Material::kNoTexture) {
+				entry.textures[t] = streamer_.Id(textures[t]);
+				if (entry.textures[t] != 0) {
+					entry.variant |= PbrFeatures::kMapFlags[t];
+				}
+			}
+		}
+		entry.base_color_factor = material.base_color_factor;
+		entry.metallic_factor = material.metallic_factor;
+		entry.roughness_factor = material.roughness_factor;
+		entry.double_sided = material.double_sided;
+		queued[i] = queue.AddMaterial(entry);
+	}
+
+	for (const Node& node : nodes_) {
+		glm::mat4 node_transform = transform * node.transform;
+		for (const Primitive& primitive : meshes_[node.mesh].primitives) {
+			bool has_material = primitive.material >= 0 && primitive.material < static_cast<int>(materials_.size());
+			queue.Submit(allocation_, primitive.first_index, primitive.index_count, primitive.base_vertex, primitive.bounds,
+				node_transform, queued[has_material ? primitive.material : materials_.size()]);
+		}
+	}
+}
+
+Aabb Model::Bounds() const
+{
+	Aabb bounds = Aabb::Empty();
+	if (!loaded_) {
+		return bounds;
+	}
+	for (const Node& node : nodes_) {
+		for (const Primitive& primitive : meshes_[node.mesh].primitives) {
+			bounds.Grow(primitive.bounds.Transformed(node.transform));
+		}
+	}
+	return bounds;
+}
+
+const std::vector<Mesh>& Model::Meshes() const
+{
+	return meshes_;
+}
+
+size_t Model::TriangleCount() const
+{
+	return triangle_count_;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "../opengl/BufferArena.h"
+#include "Bounds.h"
+#include "TextureStreamer.h"
+
+class RenderQueue;
+
+// glTF 2.0 PBR material mapped onto the pbr.frag slots: albedo 3, normal 4, ORM 5
+struct Material {
+	static const TextureStreamer::Handle kNoTexture = ~0u;
+
+	TextureStreamer::Handle albedo = kNoTexture;
+	TextureStreamer::Handle normal = kNoTexture;
+	TextureStreamer::Handle orm = kNoTexture;
+	glm::vec4 base_color_factor = glm::vec4(1.0f);
+	float metallic_factor = 1.0f;
+	float roughness_factor = 1.0f;
+	// Drawn without back-face culling
+	bool double_sided = false;
+};
+
+// A range of the model's arena allocation, indices are relative to `base_vertex`
+struct Primitive {
+	unsigned int first_index = 0;
+	unsigned int index_count = 0;
+	int base_vertex = 0;
+	int material = -1;
+	// Object space
+	Aabb bounds;
+};
+
+struct Mesh {
+	std::string name;
+	std::vector<Primitive> primitives;
+};
+
+// Loads a .gltf or .glb file. Every primitive of every mesh goes into one allocation of a BufferArena with
+// the position, normal, uv layout (Renderer::Arena), so a model adds no buffer objects or VAOs however many
+// primitives it has. Attributes are converted on all hardware threads and the
+// images are handed to the TextureStreamer, which decodes them in parallel on its pool.
+// Only triangle lists are drawn; texture samplers and sparse accessors are ignored.
+class Model
+{
+public:
+	Model(const std::string& path, TextureStreamer& streamer, BufferArena& arena);
+	~Model();
+
+	bool IsLoaded() const;
+	// Queues every primitive of every mesh node of the default scene with its material
+	void Submit(RenderQueue& queue, const glm::mat4& transform) const;
+	// Object space bounds of every mesh node of the default scene, empty until loaded
+	Aabb Bounds() const;
+
+	const std::vector<Mesh>& Meshes() const;
+	size_t TriangleCount() const;
+
+private:
+	struct Node {
+		glm::mat4 transform;
+		unsigned int mesh;
+	};
+
+	TextureStreamer& streamer_;
+	BufferArena& arena_;
+	BufferArena::Handle allocation_ = 0;
+	bool loaded_ = false;
+	std::vector<Mesh> meshes_;
+	std::vector<Material> materials_;
+	std::vector<Node> nodes_;
+	size_t texture_count_ = 0;
+	size_t triangle_count_ = 0;
+
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace Parallel {
+	inline unsigned int ThreadCount()
+	{
+		return std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	// Calls fn(i) for every i in [begin, end) on all hardware threads.
+	// Indices are handed out in chunks of `grain` through a shared counter so uneven work still balances.
+	template<typename Func>
+	void For(size_t begin, size_t end, Func&& fn, size_t grain = 1)
+	{
+		if (end <= begin) {
+			return;
+		}
+
+		std::atomic<size_t> next(begin);
+		auto worker = [&]() {
+			for (;;) {
+				size_t first = next.fetch_add(grain);
+				if (first >= end) {
+					break;
+				}
+				size_t last = std::min(first + grain, end);
+				for (size_t i = first; i < last; ++i) {
+					fn(i);
+				}
+			}
+		};
+
+		size_t chunks = (end - begin + grain - 1) / grain;
+		unsigned int thread_count = static_cast<unsigned int>(std::min<size_t>(ThreadCount(), chunks));
+		std::vector<std::thread> threads;
+		for (unsigned int i = 1; i < thread_count; ++i) {
+			threads.emplace_back(worker);
+		}
+		worker();
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+// Variant keys of pbr.frag for ShaderVariants. The map flags come from the material's textures, a material
+// without a map is drawn by a variant that doesn't sample it. The SH flag is per frame.
+namespace PbrFeatures {
+	enum : unsigned int {
+		kAlbedoMap = 1 << 0,
+		kNormalMap = 1 << 1,
+		kOrmMap = 1 << 2,
+		kShIrradiance = 1 << 3,
+	};
+	const unsigned int kMaterialMask = kAlbedoMap | kNormalMap | kOrmMap;
+	// Flag of each RenderQueue texture slot: albedo, normal, ORM
+	const unsigned int kMapFlags[3] = { kAlbedoMap, kNormalMap, kOrmMap };
+
+	// In bit order
+	constexpr const char* kFlagNames[] = { "HAS_ALBEDO_MAP", "HAS_NORMAL_MAP", "HAS_ORM_MAP", "USE_SH_IRRADIANCE" };
+}
@@ -0,0 +1,101 @@
+#include "ProgramCache.h"
+
+#include "Hash.h"
+
+#include <glad/glad.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace {
+	const char* kCacheDirectory = "cache/programs";
+	const uint32_t kMagic = 0x42505247; // "GRPB"
+	const uint32_t kVersion = 1;
+
+	struct FileHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key;
+		uint32_t format;
+		uint32_t size;
+	};
+
+	uint64_t HashGlString(GLenum name, uint64_t hash)
+	{
+		const char* value = reinterpret_cast<const char*>(glGetString(name));
+		return value ? Hash::Fnv1a64(value, std::char_traits<char>::length(value), hash) : hash;
+	}
+}
+
+uint64_t ProgramCache::ComputeKey(const std::vector<std::string>& sources)
+{
+	uint64_t hash = Hash::Fnv1a64(&kVersion, sizeof(kVersion));
+	hash = HashGlString(GL_VENDOR, hash);
+	hash = HashGlString(GL_RENDERER, hash);
+	hash = HashGlString(GL_VERSION, hash);
+	for (const std::string& source : sources) {
+		// The length separates the stages, so moving text from one stage to the next changes the key
+		uint64_t length = source.size();
+		hash = Hash::Fnv1a64(&length, sizeof(length), hash);
+		hash = Hash::Fnv1a64(source, hash);
+	}
+	return hash;
+}
+
+std::string ProgramCache::PathForKey(uint64_t key)
+{
+	return std::string(kCacheDirectory) + "/" + Hash::ToHex(key) + ".glpb";
+}
+
+bool ProgramCache::Load(uint64_t key, unsigned int& format, std::vector<unsigned char>& binary)
+{
+	std::ifstream file(PathForKey(key), std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	FileHeader header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || header.magic != kMagic || header.version != kVersion || header.key != key) {
+		std::cout << "WARNING::PROGRAM_CACHE::STALE_OR_CORRUPT_ENTRY " << PathForKey(key) << std::endl;
+		return false;
+	}
+
+	binary.resize(header.size);
+	file.read(reinterpret_cast<char*>(binary.data()), header.size);
+	if (!file) {
+		std::cout << "WARNING::PROGRAM_CACHE::STALE_OR_CORRUPT_ENTRY " << PathForKey(key) << std::endl;
+		return false;
+	}
+	format = header.format;
+	return true;
+}
+
+bool ProgramCache::Store(uint64_t key, unsigned int format, const std::vector<unsigned char>& binary)
+{
+	std::error_code error;
+	std::filesystem::create_directories(kCacheDirectory, error);
+
+	// Same temporary-file dance as the IBL cache, a crash never leaves a truncated binary for the driver
+	std::string path = PathForKey(key);
+	std::string temp_path = path + ".tmp";
+	{
+		std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+		if (!file) {
+			std::cout << "ERROR::PROGRAM_CACHE::FAILED_TO_OPEN " << temp_path << std::endl;
+			return false;
+		}
+
+		FileHeader header{ kMagic, kVersion, key, format, static_cast<uint32_t>(binary.size()) };
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(binary.data()), binary.size());
+		if (!file) {
+			std::cout << "ERROR::PROGRAM_CACHE::FAILED_TO_WRITE " << temp_path << std::endl;
+			return false;
+		}
+	}
+
+	std::filesystem::rename(temp_path, path, error);
+	return !error;
+}
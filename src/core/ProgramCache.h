@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On-disk cache of linked program binaries (glGetProgramBinary) keyed by the stage sources and the
+// driver's vendor, renderer and version strings, so a driver update or an edited shader misses.
+// Drivers may still reject a binary they produced; callers fall back to compiling in that case.
+namespace ProgramCache {
+	// `sources` are the final stage sources (defines included) in attach order. Needs a current context.
+	uint64_t ComputeKey(const std::vector<std::string>& sources);
+	std::string PathForKey(uint64_t key);
+
+	bool Load(uint64_t key, unsigned int& format, std::vector<unsigned char>& binary);
+	bool Store(uint64_t key, unsigned int format, const std::vector<unsigned char>& binary);
+}
@@ -0,0 +1,95 @@
+#include "RangeAllocator.h"
+
+#include <cassert>
+#include <iterator>
+
+RangeAllocator::RangeAllocator(size_t capacity)
+{
+	Reset(capacity);
+}
+
+void RangeAllocator::Reset(size_t capacity, size_t used)
+{
+	assert(used <= capacity);
+	free_.clear();
+	capacity_ = capacity;
+	free_size_ = capacity - used;
+	if (free_size_ > 0) {
+		free_[used] = free_size_;
+	}
+}
+
+size_t RangeAllocator::Allocate(size_t size)
+{
+	if (size == 0) {
+		return kInvalid;
+	}
+
+	auto best = free_.end();
+	for (auto block = free_.begin(); block != free_.end(); ++block) {
+		if (block->second >= size && (best == free_.end() || block->second < best->second)) {
+			best = block;
+			if (block->second == size) {
+				break;
+			}
+		}
+	}
+	if (best == free_.end()) {
+		return kInvalid;
+	}
+
+	size_t offset = best->first;
+	size_t remaining = best->second - size;
+	free_.erase(best);
+	if (remaining > 0) {
+		free_[offset + size] = remaining;
+	}
+	free_size_ -= size;
+	return offset;
+}
+
+void RangeAllocator::Free(size_t offset, size_t size)
+{
+	assert(offset + size <= capacity_);
+	auto next = free_.lower_bound(offset);
+	assert(next == free_.end() || next->first >= offset + size);
+
+	// Merge with the block that ends where this one starts and the one that starts where it ends
+	if (next != free_.begin()) {
+		auto previous = std::prev(next);
+		assert(previous->first + previous->second <= offset);
+		if (previous->first + previous->second == offset) {
+			offset = previous->first;
+			size += previous->second;
+			free_size_ -= previous->second;
+			free_.erase(previous);
+		}
+	}
+	if (next != free_.end() && next->first == offset + size) {
+		size += next->second;
+		free_size_ -= next->second;
+		free_.erase(next);
+	}
+
+	free_[offset] = size;
+	free_size_ += size;
+}
+
+size_t RangeAllocator::Capacity() const
+{
+	return capacity_;
+}
+
+size_t RangeAllocator::FreeSize() const
+{
+	return free_size_;
+}
+
+size_t RangeAllocator::LargestFree() const
+{
+	size_t largest = 0;
+	for (const auto& block : free_) {
+		largest = block.second > largest ? block.second : largest;
+	}
+	return largest;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+
+// Free-list allocator for ranges of a fixed size pool, like the elements of a GPU buffer. Allocations take the
+// smallest free block they fit in, freed ranges are merged with their free neighbours.
+class RangeAllocator
+{
+public:
+	static const size_t kInvalid = ~static_cast<size_t>(0);
+
+	explicit RangeAllocator(size_t capacity = 0);
+
+	// Forgets all allocations, [0, used) stays allocated (e.g. after compacting the pool)
+	void Reset(size_t capacity, size_t used = 0);
+
+	// Offset of the new range or kInvalid if no free block is large enough
+	size_t Allocate(size_t size);
+	void Free(size_t offset, size_t size);
+
+	size_t Capacity() const;
+	size_t FreeSize() const;
+	// Largest allocation that would succeed right now, FreeSize() minus this is lost to fragmentation
+	size_t LargestFree() const;
+
+private:
+	// Free blocks by offset
+	std::map<size_t, size_t> free_;
+	size_t capacity_ = 0;
+	size_t free_size_ = 0;
+};
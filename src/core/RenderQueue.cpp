@@ -0,0 +1,359 @@
+#include "RenderQueue.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+#include <sstream>
+
+#include "../opengl/Shader.h"
+#include "../opengl/ShaderVariants.h"
+#include "../opengl/StreamBuffer.h"
+#include "Hash.h"
+
+namespace {
+	// Index count of a packet that draws its whole allocation
+	const unsigned int kWholeMesh = ~0u;
+	// Empty slot of the state table
+	const unsigned int kNoState = ~0u;
+}
+
+RenderQueue::RenderQueue(BufferArena& arena, StreamBuffer& stream)
+	: arena_(arena), stream_(stream)
+{
+}
+
+unsigned int RenderQueue::AddMaterial(const Material& material)
+{
+	// Materials that only differ in their factors share a state and so a multi-draw
+	StateKey key = { material.variant, material.double_sided ? 1u : 0u };
+	std::copy(material.textures, material.textures + kTextureCount, key.begin() + kFirstTextureKey);
+	unsigned int state = FindState(key);
+
+	MaterialData data;
+	data.base_color_factor = material.base_color_factor;
+	data.metallic_roughness = glm::vec4(material.metallic_factor, material.roughness_factor, 0.0f, 0.0f);
+	materials_.push_back(data);
+	material_states_.push_back(state);
+	return static_cast<unsigned int>(materials_.size() - 1);
+}
+
+unsigned int RenderQueue::FindState(const StateKey& key)
+{
+	// Only grows past the most states any frame had so far
+	if (state_slots_.size() < 2 * (states_.size() + 1)) {
+		state_slots_.assign(std::max<size_t>(64, state_slots_.size() * 2), kNoState);
+		for (unsigned int state = 0; state < states_.size(); ++state) {
+			size_t mask = state_slots_.size() - 1;
+			size_t slot = Hash::Fnv1a64(states_[state].data(), sizeof(StateKey)) & mask;
+			while (state_slots_[slot] != kNoState) {
+				slot = (slot + 1) & mask;
+			}
+			state_slots_[slot] = state;
+		}
+	}
+
+	size_t mask = state_slots_.size() - 1;
+	for (size_t slot = Hash::Fnv1a64(key.data(), sizeof(StateKey)) & mask;; slot = (slot + 1) & mask) {
+		unsigned int state = state_slots_[slot];
+		if (state == kNoState) {
+			state = static_cast<unsigned int>(states_.size());
+			state_slots_[slot] = state;
+			states_.push_back(key);
+			return state;
+		}
+		if (states_[state] == key) {
+			return state;
+		}
+	}
+}
+
+void RenderQueue::Submit(BufferArena::Handle mesh, const Aabb& bounds, const glm::mat4& transform, unsigned int material)
+{
+	Submit(mesh, 0, kWholeMesh, 0, bounds, transform, material);
+}
+
+void RenderQueue::Submit(BufferArena::Handle mesh, unsigned int first_index, unsigned int index_count, int base_vertex,
+	const Aabb& bounds, const glm::mat4& transform, unsigned int material)
+{
+	Packet packet;
+	packet.mesh = mesh;
+	packet.state = material_states_[material];
+	packet.first_index = first_index;
+	packet.index_count = index_count;
+	packet.base_vertex = base_vertex;
+	packet.first_instance = instances_.size();
+	packet.instance_count = 1;
+	packets_.push_back(packet);
+
+	Instance instance;
+	instance.transform = transform;
+	instance.material = material;
+	instances_.push_back(instance);
+	culler_.Add(bounds.Transformed(transform));
+}
+
+void RenderQueue::SubmitInstanced(BufferArena::Handle mesh, const Aabb& bounds, const std::vector<Instance>& instances)
+{
+	if (instances.empty()) {
+		return;
+	}
+
+	Packet packet;
+	packet.mesh = mesh;
+	packet.state = material_states_[instances[0].material];
+	packet.first_index = 0;
+	packet.index_count = kWholeMesh;
+	packet.base_vertex = 0;
+	packet.first_instance = instances_.size();
+	packet.instance_count = static_cast<unsigned int>(instances.size());
+	packets_.push_back(packet);
+
+	for (const Instance& instance : instances) {
+		assert(material_states_[instance.material] == packet.state);
+		instances_.push_back(instance);
+		culler_.Add(bounds.Transformed(instance.transform));
+	}
+}
+
+void RenderQueue::SetEye(const glm::vec3& eye)
+{
+	eye_ = eye;
+}
+
+void RenderQueue::SetDepthPrepass(Shader* shader)
+{
+	depth_prepass_ = shader;
+}
+
+void RenderQueue::SetFrustum(const Frustum* frustum)
+{
+	culling_ = frustum != nullptr;
+	if (frustum) {
+		frustum_ = *frustum;
+	}
+}
+
+void RenderQueue::Flush(ShaderVariants& variants, unsigned int frame_key)
+{
+	// Instances outside the frustum are dropped, packets with none left are not drawn at all
+	if (culling_) {
+		culler_.Cull(frustum_);
+	}
+	visible_packets_.clear();
+	visible_counts_.resize(packets_.size());
+	size_t visible_instances = 0;
+	for (size_t packet = 0; packet < packets_.size(); ++packet) {
+		unsigned int count = 0;
+		for (unsigned int instance = 0; instance < packets_[packet].instance_count; ++instance) {
+			if (!culling_ || culler_.Visible(packets_[packet].first_instance + instance)) {
+				count++;
+			}
+		}
+		visible_counts_[packet] = count;
+		visible_instances += count;
+		if (count > 0) {
+			visible_packets_.push_back(packet);
+		}
+	}
+
+	if (!visible_packets_.empty()) {
+		// Ranks in key order put the states of one variant next to each other
+		ranked_states_.resize(states_.size());
+		for (unsigned int state = 0; state < states_.size(); ++state) {
+			ranked_states_[state] = state;
+		}
+		auto key_before = [this](unsigned int a, unsigned int b) { return states_[a] < states_[b]; };
+		std::sort(ranked_states_.begin(), ranked_states_.end(), key_before);
+		ranks_.resize(states_.size());
+		for (unsigned int rank = 0; rank < states_.size(); ++rank) {
+			ranks_[ranked_states_[rank]] = rank;
+		}
+
+		// Counting sort by rank, each state becomes one contiguous run of commands
+		offsets_.assign(states_.size() + 1, 0);
+		for (size_t packet : visible_packets_) {
+			offsets_[ranks_[packets_[packet].state] + 1]++;
+		}
+		for (size_t rank = 0; rank < states_.size(); ++rank) {
+			offsets_[rank + 1] += offsets_[rank];
+		}
+
+		order_.resize(visible_packets_.size());
+		cursor_.assign(offsets_.begin(), offsets_.end() - 1);
+		for (size_t packet : visible_packets_) {
+			order_[cursor_[ranks_[packets_[packet].state]]++] = packet;
+		}
+
+		// Front to back within each state so early depth testing rejects hidden fragments. Packets are
+		// placed by the nearest center of their visible instances' bounds.
+		distances_.resize(packets_.size());
+		for (size_t packet : visible_packets_) {
+			float nearest = std::numeric_limits<float>::max();
+			for (unsigned int instance = 0; instance < packets_[packet].instance_count; ++instance) {
+				size_t index = packets_[packet].first_instance + instance;
+				if (!culling_ || culler_.Visible(index)) {
+					glm::vec3 offset = culler_.Center(index) - eye_;
+					nearest = std::min(nearest, glm::dot(offset, offset));
+				}
+			}
+			distances_[packet] = nearest;
+		}
+		auto nearer = [this](size_t a, size_t b) { return distances_[a] < distances_[b]; };
+		for (size_t rank = 0; rank < states_.size(); ++rank) {
+			std::sort(order_.begin() + offsets_[rank], order_.begin() + offsets_[rank + 1], nearer);
+		}
+
+		// The instances of a command are consecutive entries starting at its baseInstance
+		commands_.resize(order_.size());
+		draws_.resize(visible_instances);
+		size_t next_draw = 0;
+		for (size_t i = 0; i < order_.size(); ++i) {
+			const Packet& packet = packets_[order_[i]];
+			BufferArena::Range range = arena_.Get(packet.mesh);
+
+			DrawCommand& command = commands_[i];
+			command.count = packet.index_count == kWholeMesh ? range.index_count : packet.index_count;
+			command.instance_count = visible_counts_[order_[i]];
+			command.first_index = range.first_index + packet.first_index;
+			command.base_vertex = range.base_vertex + packet.base_vertex;
+			command.base_instance = static_cast<unsigned int>(next_draw);
+
+			for (unsigned int instance = 0; instance < packet.instance_count; ++instance) {
+				if (culling_ && !culler_.Visible(packet.first_instance + instance)) {
+					continue;
+				}
+				const Instance& source = instances_[packet.first_instance + instance];
+				draws_[next_draw].model = source.transform;
+				draws_[next_draw].material = glm::uvec4(source.material, 0, 0, 0);
+				next_draw++;
+			}
+		}
+
+		// The pre-pass draws the same commands in one front-to-back run, culled ones first
+		size_t culled_count = 0;
+		if (depth_prepass_) {
+			depth_order_.resize(order_.size());
+			for (size_t i = 0; i < order_.size(); ++i) {
+				depth_order_[i] = i;
+			}
+			auto depth_before = [&](size_t a, size_t b) {
+				unsigned int a_double_sided = states_[packets_[order_[a]].state][1];
+				unsigned int b_double_sided = states_[packets_[order_[b]].state][1];
+				if (a_double_sided != b_double_sided) {
+					return a_double_sided < b_double_sided;
+				}
+				return distances_[order_[a]] < distances_[order_[b]];
+			};
+			std::sort(depth_order_.begin(), depth_order_.end(), depth_before);
+			depth_commands_.resize(order_.size());
+			for (size_t i = 0; i < order_.size(); ++i) {
+				depth_commands_[i] = commands_[depth_order_[i]];
+				if (!states_[packets_[order_[depth_order_[i]]].state][1]) {
+					culled_count++;
+				}
+			}
+		}
+
+		size_t command_bytes = commands_.size() * sizeof(DrawCommand);
+		size_t depth_command_bytes = depth_prepass_ ? depth_commands_.size() * sizeof(DrawCommand) : 0;
+		size_t draw_bytes = draws_.size() * sizeof(DrawData);
+		size_t material_bytes = materials_.size() * sizeof(MaterialData);
+		stream_.Reserve(command_bytes + depth_command_bytes + draw_bytes + material_bytes, 4);
+		size_t command_offset = stream_.Write(commands_.data(), command_bytes);
+		size_t depth_command_offset = depth_prepass_ ? stream_.Write(depth_commands_.data(), depth_command_bytes) : 0;
+		size_t draw_offset = stream_.Write(draws_.data(), draw_bytes);
+		size_t material_offset = stream_.Write(materials_.data(), material_bytes);
+		stream_.BindRange(GL_SHADER_STORAGE_BUFFER, kDrawBinding, draw_offset, draw_bytes);
+		stream_.BindRange(GL_SHADER_STORAGE_BUFFER, kMaterialBinding, material_offset, material_bytes);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, stream_.Id());
+
+		arena_.Bind();
+		last_batches_ = 0;
+		last_programs_ = 0;
+		if (depth_prepass_) {
+			// Depth only, the shading pass below then passes GL_EQUAL exactly once per pixel. Both vertex
+			// shaders compute an invariant gl_Position, so the depths match bit for bit.
+			depth_prepass_->Bind();
+			glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+			glDepthFunc(GL_LESS);
+			glEnable(GL_CULL_FACE);
+			if (culled_count > 0) {
+				glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+					reinterpret_cast<void*>(depth_command_offset), static_cast<GLsizei>(culled_count), 0);
+			}
+			glDisable(GL_CULL_FACE);
+			if (culled_count < depth_commands_.size()) {
+				glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+					reinterpret_cast<void*>(depth_command_offset + culled_count * sizeof(DrawCommand)),
+					static_cast<GLsizei>(depth_commands_.size() - culled_count), 0);
+			}
+			glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+			glDepthFunc(GL_EQUAL);
+			glDepthMask(GL_FALSE);
+			last_programs_++;
+		}
+		bool bound = false;
+		unsigned int bound_variant = 0;
+		for (size_t rank = 0; rank < states_.size(); ++rank) {
+			size_t count = offsets_[rank + 1] - offsets_[rank];
+			if (count == 0) {
+				continue;
+			}
+			const StateKey& key = states_[ranked_states_[rank]];
+			if (!bound || key[0] != bound_variant) {
+				variants.Get(key[0] | frame_key).Bind();
+				bound = true;
+				bound_variant = key[0];
+				last_programs_++;
+			}
+			if (key[1]) {
+				glDisable(GL_CULL_FACE);
+			}
+			else {
+				glEnable(GL_CULL_FACE);
+			}
+			for (unsigned int t = 0; t < kTextureCount; ++t) {
+				glActiveTexture(GL_TEXTURE0 + kFirstTextureSlot + t);
+				glBindTexture(GL_TEXTURE_2D, key[kFirstTextureKey + t]);
+			}
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+				reinterpret_cast<void*>(command_offset + offsets_[rank] * sizeof(DrawCommand)), static_cast<GLsizei>(count), 0);
+			last_batches_++;
+		}
+		arena_.Unbind();
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		// Back to the defaults set up in main
+		glDisable(GL_CULL_FACE);
+		if (depth_prepass_) {
+			glDepthFunc(GL_LEQUAL);
+			glDepthMask(GL_TRUE);
+		}
+	}
+	else {
+		last_batches_ = 0;
+		last_programs_ = 0;
+	}
+
+	last_prepass_ = depth_prepass_ && !visible_packets_.empty();
+	last_draws_ = visible_packets_.size();
+	last_instances_ = visible_instances;
+	last_culled_ = instances_.size() - visible_instances;
+	packets_.clear();
+	instances_.clear();
+	culler_.Clear();
+	materials_.clear();
+	material_states_.clear();
+	std::fill(state_slots_.begin(), state_slots_.end(), kNoState);
+	states_.clear();
+}
+
+std::string RenderQueue::Report() const
+{
+	std::ostringstream report;
+	report << "Draws: " << last_draws_ << " (" << last_instances_ << " instances, " << last_culled_ << " culled) in " << last_batches_ << " multi-draws, "
+		<< last_programs_ << " programs" << (last_prepass_ ? ", depth pre-pass" : "");
+	return report.str();
+}
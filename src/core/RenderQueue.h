@@ -0,0 +1,155 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "../opengl/BufferArena.h"
+#include "Bounds.h"
+#include "FrustumCuller.h"
+
+class Shader;
+class ShaderVariants;
+class StreamBuffer;
+
+// Collects the draws of a frame and submits them with one glMultiDrawElementsIndirect per shader variant and
+// texture set. The sets of one variant are drawn together, so each variant is bound once per flush.
+// Every draw becomes a DrawElementsIndirectCommand whose baseInstance indexes its transform and material in
+// shader storage buffers (binding kDrawBinding and kMaterialBinding, see pbr.vert/pbr.frag), so there are no
+// per-draw uniform updates or binds and the CPU cost per draw is a few stores.
+// Instanced packets become a single command with an instance count, pbr.vert finds the per-instance entry at
+// gl_BaseInstance + gl_InstanceID.
+// The commands and both buffers are written into the frame's StreamBuffer segment. All other per-frame arrays and
+// the state table are members that keep their capacity, so once the scene's sizes are reached nothing is allocated.
+// Within a state the draws go front to back from the eye and back faces are culled unless the material is double
+// sided. With a frustum set, every instance's bounds are culled first (FrustumCuller) and only the visible ones
+// get a draw entry. With a depth pre-pass program all draws first lay down depth in one front-to-back multi-draw, then the
+// shading pass runs with GL_EQUAL, so the pbr program runs at most once per pixel.
+// All meshes have to come from the arena the queue was created with, they share its VAO.
+class RenderQueue
+{
+public:
+	static const unsigned int kDrawBinding = 0;
+	static const unsigned int kMaterialBinding = 1;
+	// albedo, normal and ORM on the pbr.frag slots 3-5
+	static const unsigned int kTextureCount = 3;
+	static const unsigned int kFirstTextureSlot = 3;
+
+	struct Material {
+		unsigned int textures[kTextureCount] = { 0, 0, 0 };
+		glm::vec4 base_color_factor = glm::vec4(1.0f);
+		float metallic_factor = 1.0f;
+		float roughness_factor = 1.0f;
+		// Material flags of the shader variant (PbrFeatures), combined with the frame key at Flush
+		unsigned int variant = 0;
+		bool double_sided = false;
+	};
+
+	struct Instance {
+		glm::mat4 transform = glm::mat4(1.0f);
+		unsigned int material = 0;
+	};
+
+	RenderQueue(BufferArena& arena, StreamBuffer& stream);
+
+	// Index for Submit, valid until the next Flush. Textures are GL names, so streamed textures are added each frame.
+	unsigned int AddMaterial(const Material& material);
+
+	// Whole allocation or a part of it, `first_index` and `base_vertex` are relative to the allocation. Ranges are
+	// looked up at Flush, so the arena may still move them in between. `bounds` are in object space.
+	void Submit(BufferArena::Handle mesh, const Aabb& bounds, const glm::mat4& transform, unsigned int material);
+	void Submit(BufferArena::Handle mesh, unsigned int first_index, unsigned int index_count, int base_vertex,
+		const Aabb& bounds, const glm::mat4& transform, unsigned int material);
+	// Whole allocation once per instance with one command. The materials of all instances need the same textures
+	// and variant, only their factors may differ. Culled instances are left out of the command.
+	void SubmitInstanced(BufferArena::Handle mesh, const Aabb& bounds, const std::vector<Instance>& instances);
+
+	// Camera position for the front-to-back order of the next Flush
+	void SetEye(const glm::vec3& eye);
+	// Position only program for a depth pre-pass in the next Flush (see depth.vert), nullptr for none
+	void SetDepthPrepass(Shader* shader);
+	// World space frustum the next Flush culls against, nullptr draws everything
+	void SetFrustum(const Frustum* frustum);
+
+	// Draws everything with the variant `material.variant | frame_key` of each material and empties the queue
+	void Flush(ShaderVariants& variants, unsigned int frame_key);
+
+	// Draws, instances, culled instances, multi-draws and programs of the last Flush
+	std::string Report() const;
+
+private:
+	// Layouts as seen by the shaders (std430)
+	struct DrawCommand {
+		unsigned int count;
+		unsigned int instance_count;
+		unsigned int first_index;
+		int base_vertex;
+		unsigned int base_instance;
+	};
+	struct DrawData {
+		glm::mat4 model;
+		glm::uvec4 material;
+	};
+	struct MaterialData {
+		glm::vec4 base_color_factor;
+		glm::vec4 metallic_roughness;
+	};
+
+	struct Packet {
+		BufferArena::Handle mesh;
+		unsigned int state;
+		unsigned int first_index;
+		unsigned int index_count;
+		int base_vertex;
+		// Range in instances_
+		size_t first_instance;
+		unsigned int instance_count;
+	};
+	// Variant, double sided and the texture names, states are ordered by variant first
+	using StateKey = std::array<unsigned int, 2 + kTextureCount>;
+	static const unsigned int kFirstTextureKey = 2;
+
+	BufferArena& arena_;
+	StreamBuffer& stream_;
+
+	std::vector<Packet> packets_;
+	std::vector<Instance> instances_;
+	std::vector<MaterialData> materials_;
+	std::vector<unsigned int> material_states_;
+	std::vector<StateKey> states_;
+	// Open addressing table of indices into states_, a power of two at most half full
+	std::vector<unsigned int> state_slots_;
+
+	glm::vec3 eye_ = glm::vec3(0.0f);
+	Shader* depth_prepass_ = nullptr;
+	Frustum frustum_ = {};
+	bool culling_ = false;
+
+	// World space bounds of instances_, same indices
+	FrustumCuller culler_;
+	std::vector<size_t> visible_packets_;
+	std::vector<unsigned int> visible_counts_;
+
+	// State rank and the counting sort of Flush
+	std::vector<unsigned int> ranks_;
+	std::vector<unsigned int> ranked_states_;
+	std::vector<size_t> offsets_;
+	std::vector<size_t> cursor_;
+	std::vector<size_t> order_;
+
+	std::vector<DrawCommand> commands_;
+	std::vector<DrawCommand> depth_commands_;
+	std::vector<DrawData> draws_;
+	std::vector<float> distances_;
+	std::vector<size_t> depth_order_;
+	size_t last_draws_ = 0;
+	size_t last_instances_ = 0;
+	size_t last_culled_ = 0;
+	size_t last_batches_ = 0;
+	size_t last_programs_ = 0;
+	bool last_prepass_ = false;
+
+	unsigned int FindState(const StateKey& key);
+};
@@ -4,6 +4,16 @@
 
 #include "../opengl/Shader.h"
 
+Renderer::Renderer()
+	: arena_({ { 3, GL_FLOAT, 8 }, { 3, GL_FLOAT, 8 }, { 2, GL_FLOAT, 8 } }, kArenaVertices, kArenaIndices)
+{
+}
+
+BufferArena& Renderer::Arena()
+{
+	return arena_;
+}
+
 void Renderer::Clear()
 {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -24,14 +34,16 @@ void Renderer::Draw()
 
 void Renderer::DrawSphere()
 {
-	if (spherevao_ == 0)
-	{
-		glGenVertexArrays(1, &spherevao_);
-
-		unsigned int vbo, ebo;
-		glGenBuffers(1, &vbo);
-		glGenBuffers(1, &ebo);
+	BufferArena::Handle sphere = SphereMesh();
+	arena_.Bind();
+	arena_.Draw(sphere);
+	arena_.Unbind();
+}
 
+BufferArena::Handle Renderer::SphereMesh()
+{
+	if (!sphere_allocated_)
+	{
 		std::vector<glm::vec3> positions;
 		std::vector<glm::vec2> uv;
 		std::vector<glm::vec3> normals;
@@ -56,28 +68,21 @@ void Renderer::DrawSphere()
 			}
 		}
 
-		bool oddRow = false;
+		// Triangle list rather than a strip so the sphere can share draws with the other arena meshes
 		for (unsigned int y = 0; y < Y_SEGMENTS; ++y)
 		{
-			if (!oddRow) // even rows: y == 0, y == 2; and so on
-			{
-				for (unsigned int x = 0; x <= X_SEGMENTS; ++x)
-				{
-					indices.push_back(y * (X_SEGMENTS + 1) + x);
-					indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
-				}
-			}
-			else
+			for (unsigned int x = 0; x < X_SEGMENTS; ++x)
 			{
-				for (int x = X_SEGMENTS; x >= 0; --x)
-				{
-					indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
-					indices.push_back(y * (X_SEGMENTS + 1) + x);
-				}
+				unsigned int top_left = y * (X_SEGMENTS + 1) + x;
+				unsigned int bottom_left = (y + 1) * (X_SEGMENTS + 1) + x;
+				indices.push_back(top_left);
+				indices.push_back(bottom_left);
+				indices.push_back(top_left + 1);
+				indices.push_back(top_left + 1);
+				indices.push_back(bottom_left);
+				indices.push_back(bottom_left + 1);
 			}
-			oddRow = !oddRow;
 		}
-		index_count_ = static_cast<unsigned int>(indices.size());
 
 		std::vector<float> data;
 		for (unsigned int i = 0; i < positions.size(); ++i)
@@ -97,28 +102,29 @@ void Renderer::DrawSphere()
 				data.push_back(uv[i].y);
 			}
 		}
-		glBindVertexArray(spherevao_);
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-		unsigned int stride = (3 + 2 + 3) * sizeof(float);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+		sphere_ = arena_.Allocate(data.data(), static_cast<unsigned int>(positions.size()), indices.data(), static_cast<unsigned int>(indices.size()));
+		sphere_allocated_ = true;
 	}
+	return sphere_;
+}
 
-	glBindVertexArray(spherevao_);
-	glDrawElements(GL_TRIANGLE_STRIP, index_count_, GL_UNSIGNED_INT, 0);
+Aabb Renderer::SphereBounds() const
+{
+	return { glm::vec3(-1.0f), glm::vec3(1.0f) };
 }
 
 void Renderer::DrawCube()
+{
+	BufferArena::Handle cube = CubeMesh();
+	arena_.Bind();
+	arena_.Draw(cube);
+	arena_.Unbind();
+}
+
+BufferArena::Handle Renderer::CubeMesh()
 {
 	// initialize (if necessary)
-	if (cubevao_ == 0)
+	if (!cube_allocated_)
 	{
 		float vertices[] = {
 			// back face
@@ -164,26 +170,20 @@ void Renderer::DrawCube()
 			 -1.0f,  1.0f, -1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 1.0f, // top-left
 			 -1.0f,  1.0f,  1.0f,  0.0f,  1.0f,  0.0f, 0.0f, 0.0f  // bottom-left
 		};
-		glGenVertexArrays(1, &cubevao_);
-		glGenBuffers(1, &cubevbo_);
-		// fill buffer
-		glBindBuffer(GL_ARRAY_BUFFER, cubevbo_);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-		// link vertex attributes
-		glBindVertexArray(cubevao_);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindVertexArray(0);
+		unsigned int indices[36];
+		for (unsigned int i = 0; i < 36; ++i)
+		{
+			indices[i] = i;
+		}
+		cube_ = arena_.Allocate(vertices, 36, indices, 36);
+		cube_allocated_ = true;
 	}
-	// render Cube
-	glBindVertexArray(cubevao_);
-	glDrawArrays(GL_TRIANGLES, 0, 36);
-	glBindVertexArray(0);
+	return cube_;
+}
+
+Aabb Renderer::CubeBounds() const
+{
+	return { glm::vec3(-1.0f), glm::vec3(1.0f) };
 }
 
 void Renderer::DrawQuad()
@@ -215,16 +215,6 @@ void Renderer::DrawQuad()
 
 Renderer::~Renderer()
 {
-	if (spherevao_ != 0 && spherevbo_ != 0) {
-		glDeleteVertexArrays(1, &spherevao_);
-		glDeleteBuffers(1, &spherevbo_);
-	}
-
-	if (cubevao_ != 0 && cubevbo_ != 0) {
-		glDeleteVertexArrays(1, &cubevao_);
-		glDeleteBuffers(1, &cubevbo_);
-	}
-
 	if (quadvao_ != 0 && quadvbo_ != 0) {
 		glDeleteVertexArrays(1, &quadvao_);
 		glDeleteBuffers(1, &quadvbo_);
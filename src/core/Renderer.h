@@ -2,12 +2,16 @@
 
 #include "../opengl/VertexArray.h"
 #include "../opengl/IndexBuffer.h"
+#include "../opengl/BufferArena.h"
+#include "Bounds.h"
 
 class Shader;
 
 class Renderer
 {
 public:
+	Renderer();
+
 	void Clear();
 	void DrawIndexed(const VertexArray& vao, const IndexBuffer& ibo, const Shader& shader) const;
 	void Draw();
@@ -16,10 +20,23 @@ public:
 	void DrawCube();
 	void DrawQuad();
 
+	// Shared buffers for every mesh with the position, normal, uv layout (the sphere, the cube and models)
+	BufferArena& Arena();
+	// The built-in meshes as arena allocations, for RenderQueue
+	BufferArena::Handle SphereMesh();
+	BufferArena::Handle CubeMesh();
+	// Their object space bounds, both span -1 to 1 on every axis
+	Aabb SphereBounds() const;
+	Aabb CubeBounds() const;
+
 	~Renderer();
 private:
-	unsigned int index_count_;
-	unsigned int spherevao_ = 0, spherevbo_ = 0;
-	unsigned int cubevao_ = 0, cubevbo_ = 0;
+	static const unsigned int kArenaVertices = 256 * 1024;
+	static const unsigned int kArenaIndices = 1024 * 1024;
+
+	BufferArena arena_;
+	BufferArena::Handle sphere_ = 0, cube_ = 0;
+	bool sphere_allocated_ = false, cube_allocated_ = false;
+	// The quad only has positions and uvs, it keeps its own buffer
 	unsigned int quadvao_ = 0, quadvbo_ = 0;
 };
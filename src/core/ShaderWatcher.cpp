@@ -0,0 +1,36 @@
+#include "ShaderWatcher.h"
+
+#include <iostream>
+
+#include "../opengl/Shader.h"
+
+ShaderWatcher::ShaderWatcher(double interval_seconds)
+	: interval_(interval_seconds)
+{
+}
+
+void ShaderWatcher::Watch(Shader& shader)
+{
+	shaders_.push_back(&shader);
+}
+
+unsigned int ShaderWatcher::Update(double time)
+{
+	if (time - last_poll_ >= interval_) {
+		last_poll_ = time;
+		for (Shader* shader : shaders_) {
+			if (shader->SourcesChanged()) {
+				std::cout << "SHADER::RELOADING " << shader->GetName() << std::endl;
+				shader->Reload();
+			}
+		}
+	}
+
+	unsigned int swapped = 0;
+	for (Shader* shader : shaders_) {
+		if (shader->UpdateReload()) {
+			swapped++;
+		}
+	}
+	return swapped;
+}
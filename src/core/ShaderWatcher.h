@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+
+class Shader;
+
+// Hot reload for look-dev: polls the source files (includes too) of the watched programs and rebuilds only
+// the ones whose files changed. Rebuilds compile in the background and are swapped in between frames.
+// Polling modification times instead of inotify/ReadDirectoryChangesW keeps it portable, a few stat calls
+// twice a second cost nothing.
+class ShaderWatcher
+{
+public:
+	explicit ShaderWatcher(double interval_seconds = 0.5);
+
+	void Watch(Shader& shader);
+	// Call once per frame, returns the number of programs swapped in
+	unsigned int Update(double time);
+
+private:
+	std::vector<Shader*> shaders_;
+	double interval_;
+	double last_poll_ = 0.0;
+};
@@ -0,0 +1,397 @@
+#include "TextureStreamer.h"
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+namespace {
+	GLenum InternalFormat(unsigned int channels)
+	{
+		switch (channels)
+		{
+		case 1: return GL_R8;
+		case 2: return GL_RG8;
+		case 3: return GL_RGB8;
+		default: return GL_RGBA8;
+		}
+	}
+
+	GLenum PixelFormat(unsigned int channels)
+	{
+		switch (channels)
+		{
+		case 1: return GL_RED;
+		case 2: return GL_RG;
+		case 3: return GL_RGB;
+		default: return GL_RGBA;
+		}
+	}
+}
+
+TextureStreamer::TextureStreamer(ThreadPool& pool, size_t memory_cap, size_t upload_budget)
+	: pool_(pool), memory_cap_(memory_cap), upload_budget_(upload_budget)
+{
+	glGenBuffers(1, &upload_pbo_);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	for (std::unique_ptr<Entry>& entry : entries_) {
+		if (entry->decoding.valid()) {
+			entry->decoding.wait();
+		}
+		glDeleteTextures(1, &entry->id);
+	}
+	glDeleteBuffers(1, &upload_pbo_);
+}
+
+TextureStreamer::Handle TextureStreamer::Load(const std::string& path, bool flip_vertically)
+{
+	return Add(path, pool_.Submit([path, flip_vertically]() { return Decode(Source(path), flip_vertically); }));
+}
+
+TextureStreamer::Handle TextureStreamer::LoadEncoded(const std::string& name, std::shared_ptr<const std::vector<unsigned char>> encoded, bool flip_vertically)
+{
+	return Add(name, pool_.Submit([encoded, flip_vertically]() { return Decode(Source(encoded), flip_vertically); }));
+}
+
+TextureStreamer::Handle TextureStreamer::LoadOrm(const std::string& packed_path, const Source& occlusion,
+	const Source& roughness, const Source& metallic, bool flip_vertically)
+{
+	return Add(packed_path, pool_.Submit([=]() {
+		const Source sources[3] = { occlusion, roughness, metallic };
+		return DecodeOrm(packed_path, sources, flip_vertically);
+	}));
+}
+
+TextureStreamer::Handle TextureStreamer::Add(const std::string& path, std::future<Decoded> decoding)
+{
+	std::unique_ptr<Entry> entry = std::make_unique<Entry>();
+	entry->path = path;
+	entry->decoding = std::move(decoding);
+	entries_.push_back(std::move(entry));
+	return static_cast<Handle>(entries_.size() - 1);
+}
+
+TextureStreamer::Decoded TextureStreamer::Decode(const Source& source, bool flip_vertically)
+{
+	Decoded decoded;
+	auto start = std::chrono::steady_clock::now();
+
+	// Prefer an offline compressed version, its flip was applied when it was encoded
+	if (source.path.empty() || !DecodeCompressed(source.path.substr(0, source.path.find_last_of('.')) + ".btex", decoded)) {
+		Mip base;
+		if (!DecodeImage(source, flip_vertically, base)) {
+			return decoded;
+		}
+		decoded.internal_format = InternalFormat(base.channels);
+		decoded.mips = BlockCompression::GenerateMipChain(std::move(base));
+	}
+	decoded.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return decoded;
+}
+
+TextureStreamer::Decoded TextureStreamer::DecodeOrm(const std::string& packed_path, const Source sources[3], bool flip_vertically)
+{
+	Decoded decoded;
+	auto start = std::chrono::steady_clock::now();
+
+	if (!DecodeCompressed(packed_path, decoded)) {
+		// Maps that share a source, like a glTF occlusion map packed with metallic-roughness, are decoded once.
+		// A map that fails to decode is treated as missing and gets its neutral value, the others are kept.
+		Mip maps[3];
+		bool loaded[3] = { false, false, false };
+		bool any_loaded = false;
+		BlockCompression::Channel channels[3];
+		for (int i = 0; i < 3; ++i) {
+			channels[i].neutral = sources[i].neutral;
+			if (sources[i].Empty()) {
+				continue;
+			}
+			int shared = -1;
+			for (int j = 0; j < i; ++j) {
+				if (sources[j].path == sources[i].path && sources[j].encoded == sources[i].encoded) {
+					shared = j;
+				}
+			}
+			loaded[i] = shared < 0 ? DecodeImage(sources[i], flip_vertically, maps[i]) : loaded[shared];
+			if (!loaded[i]) {
+				std::cout << "WARNING::TEXTURE_STREAMER::ORM_CHANNEL_NEUTRAL " << i << " " << packed_path << std::endl;
+				continue;
+			}
+			any_loaded = true;
+			channels[i].image = &maps[shared < 0 ? i : shared];
+			channels[i].index = sources[i].channel;
+		}
+		if (!any_loaded) {
+			return decoded;
+		}
+
+		Mip packed = BlockCompression::PackOrm(channels[0], channels[1], channels[2]);
+		if (packed.pixels.empty()) {
+			std::cout << "ERROR::TEXTURE_STREAMER::FAILED_TO_PACK " << packed_path << std::endl;
+			return decoded;
+		}
+		decoded.internal_format = InternalFormat(packed.channels);
+		decoded.mips = BlockCompression::GenerateMipChain(std::move(packed));
+	}
+	decoded.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return decoded;
+}
+
+bool TextureStreamer::DecodeCompressed(const std::string& path, Decoded& decoded)
+{
+	BlockCompression::CompressedImage compressed;
+	if (!BlockCompression::ReadContainer(path, compressed)) {
+		return false;
+	}
+
+	decoded.internal_format = compressed.internal_format;
+	decoded.compressed = true;
+	for (size_t mip = 0; mip < compressed.mips.size(); ++mip) {
+		Mip level;
+		level.width = std::max(1u, compressed.width >> mip);
+		level.height = std::max(1u, compressed.height >> mip);
+		level.pixels = std::move(compressed.mips[mip]);
+		decoded.mips.push_back(std::move(level));
+	}
+	return true;
+}
+
+bool TextureStreamer::DecodeImage(const Source& source, bool flip_vertically, Mip& image)
+{
+	stbi_set_flip_vertically_on_load_thread(flip_vertically);
+	int width = 0, height = 0, channels = 0;
+	unsigned char* data = source.encoded
+		? stbi_load_from_memory(source.encoded->data(), static_cast<int>(source.encoded->size()), &width, &height, &channels, 0)
+		: stbi_load(source.path.c_str(), &width, &height, &channels, 0);
+	if (!data) {
+		std::cout << "ERROR::TEXTURE_STREAMER::FAILED_TO_LOAD_IMAGE " << (source.encoded ? "<memory>" : source.path) << std::endl;
+		return false;
+	}
+
+	image.width = width;
+	image.height = height;
+	image.channels = channels;
+	image.pixels.assign(data, data + static_cast<size_t>(width) * height * channels);
+	stbi_image_free(data);
+	return true;
+}
+
+void TextureStreamer::Bind(Handle handle, unsigned int slot) const
+{
+	glActiveTexture(GL_TEXTURE0 + slot);
+	glBindTexture(GL_TEXTURE_2D, entries_[handle]->id);
+}
+
+unsigned int TextureStreamer::Id(Handle handle) const
+{
+	return entries_[handle]->id;
+}
+
+void TextureStreamer::SetFootprint(Handle handle, float pixels)
+{
+	Entry& entry = *entries_[handle];
+	if (entry.mips.empty()) {
+		return;
+	}
+
+	// One texel per pixel: every halving of the footprint drops one level
+	unsigned int size = std::max(entry.mips[0].width, entry.mips[0].height);
+	float level = std::floor(std::log2(static_cast<float>(size) / std::max(pixels, 1.0f)));
+	unsigned int last = static_cast<unsigned int>(entry.mips.size() - 1);
+	entry.wanted_mip = std::min(static_cast<unsigned int>(std::max(level, 0.0f)), MipTailLevel(entry));
+	entry.wanted_mip = std::min(entry.wanted_mip, last);
+}
+
+float TextureStreamer::ProjectedSize(const glm::vec3& center, float radius, const glm::vec3& eye, float fov_y_radians, float viewport_height)
+{
+	float distance = std::max(glm::length(center - eye) - radius, 0.01f);
+	return radius * 2.0f / (distance * std::tan(fov_y_radians * 0.5f)) * viewport_height * 0.5f;
+}
+
+unsigned int TextureStreamer::MipTailLevel(const Entry& entry) const
+{
+	unsigned int level = 0;
+	while (level + 1 < entry.mips.size() && std::max(entry.mips[level].width, entry.mips[level].height) > kMipTailSize) {
+		level++;
+	}
+	return level;
+}
+
+size_t TextureStreamer::LevelBytes(const Entry& entry, unsigned int first_mip) const
+{
+	size_t bytes = 0;
+	for (size_t mip = first_mip; mip < entry.mips.size(); ++mip) {
+		bytes += entry.mips[mip].pixels.size();
+	}
+	return bytes;
+}
+
+void TextureStreamer::Reallocate(Entry& entry, unsigned int first_mip)
+{
+	unsigned int levels = static_cast<unsigned int>(entry.mips.size()) - first_mip;
+	const Mip& top = entry.mips[first_mip];
+
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexStorage2D(GL_TEXTURE_2D, levels, entry.internal_format, top.width, top.height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	// Levels that are already resident are copied on the GPU, only new ones come from memory
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload_pbo_);
+	for (unsigned int mip = first_mip; mip < entry.mips.size(); ++mip) {
+		const Mip& level = entry.mips[mip];
+		if (entry.id != 0 && mip >= entry.resident_mip) {
+			glCopyImageSubData(entry.id, GL_TEXTURE_2D, mip - entry.resident_mip, 0, 0, 0,
+				texture, GL_TEXTURE_2D, mip - first_mip, 0, 0, 0, level.width, level.height, 1);
+		}
+		else {
+			// Orphan the buffer so an upload that is still in flight keeps its storage, then
+			// source the texture from it and let the driver do the transfer asynchronously
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, level.pixels.size(), nullptr, GL_STREAM_DRAW);
+			void* staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, level.pixels.size(), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+			std::memcpy(staging, level.pixels.data(), level.pixels.size());
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			if (entry.compressed) {
+				glCompressedTexSubImage2D(GL_TEXTURE_2D, mip - first_mip, 0, 0, level.width, level.height,
+					entry.internal_format, static_cast<GLsizei>(level.pixels.size()), nullptr);
+			}
+			else {
+				glTexSubImage2D(GL_TEXTURE_2D, mip - first_mip, 0, 0, level.width, level.height,
+					PixelFormat(level.channels), GL_UNSIGNED_BYTE, nullptr);
+			}
+		}
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	glDeleteTextures(1, &entry.id);
+	entry.id = texture;
+	entry.resident_mip = first_mip;
+
+	resident_bytes_ -= entry.resident_bytes;
+	entry.resident_bytes = LevelBytes(entry, first_mip);
+	resident_bytes_ += entry.resident_bytes;
+}
+
+void TextureStreamer::Update()
+{
+	size_t uploaded = 0;
+
+	// Freshly decoded textures get their mip tail right away, regardless of the budget
+	for (std::unique_ptr<Entry>& entry : entries_) {
+		if (!entry->decoding.valid() || entry->decoding.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			continue;
+		}
+
+		Decoded decoded = entry->decoding.get();
+		if (decoded.mips.empty()) {
+			continue;
+		}
+		entry->decode_milliseconds = decoded.milliseconds;
+		entry->internal_format = decoded.internal_format;
+		entry->compressed = decoded.compressed;
+		entry->mips = std::move(decoded.mips);
+		entry->resident_mip = static_cast<unsigned int>(entry->mips.size());
+
+		unsigned int tail = MipTailLevel(*entry);
+		Reallocate(*entry, tail);
+		uploaded += entry->resident_bytes;
+	}
+
+	// Then one level per step for the texture furthest away from the level it wants
+	while (uploaded < upload_budget_) {
+		Entry* grow = nullptr;
+		for (std::unique_ptr<Entry>& entry : entries_) {
+			if (entry->id != 0 && entry->resident_mip > entry->wanted_mip &&
+				(!grow || entry->resident_mip - entry->wanted_mip > grow->resident_mip - grow->wanted_mip)) {
+				grow = entry.get();
+			}
+		}
+		if (!grow) {
+			break;
+		}
+
+		size_t cost = grow->mips[grow->resident_mip - 1].pixels.size();
+		while (resident_bytes_ + cost > memory_cap_) {
+			// Take a level back from the most over-resident texture, never below its mip tail
+			Entry* shrink = nullptr;
+			for (std::unique_ptr<Entry>& entry : entries_) {
+				if (entry.get() != grow && entry->id != 0 && entry->resident_mip < entry->wanted_mip &&
+					(!shrink || entry->wanted_mip - entry->resident_mip > shrink->wanted_mip - shrink->resident_mip)) {
+					shrink = entry.get();
+				}
+			}
+			if (!shrink) {
+				break;
+			}
+			Reallocate(*shrink, shrink->resident_mip + 1);
+		}
+		if (resident_bytes_ + cost > memory_cap_) {
+			break;
+		}
+
+		Reallocate(*grow, grow->resident_mip - 1);
+		uploaded += cost;
+	}
+}
+
+bool TextureStreamer::TailsResident() const
+{
+	for (const std::unique_ptr<Entry>& entry : entries_) {
+		if (entry->decoding.valid()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+double TextureStreamer::DecodeMilliseconds() const
+{
+	double milliseconds = 0.0;
+	for (const std::unique_ptr<Entry>& entry : entries_) {
+		milliseconds += entry->decode_milliseconds;
+	}
+	return milliseconds;
+}
+
+size_t TextureStreamer::ResidentBytes() const
+{
+	return resident_bytes_;
+}
+
+size_t TextureStreamer::ResidentBytes(Handle handle) const
+{
+	return entries_[handle]->resident_bytes;
+}
+
+std::string TextureStreamer::Report() const
+{
+	std::ostringstream report;
+	for (const std::unique_ptr<Entry>& entry : entries_) {
+		std::string name = entry->path.substr(entry->path.find_last_of("/\\") + 1);
+		if (entry->id == 0) {
+			report << name << ": loading\n";
+			continue;
+		}
+		const Mip& resident = entry->mips[entry->resident_mip];
+		report << name << ": " << resident.width << "x" << resident.height << " (mip " << entry->resident_mip
+			<< ", wants " << entry->wanted_mip << ") " << entry->resident_bytes / 1024 << " KB\n";
+	}
+	report << "Total: " << resident_bytes_ / (1024 * 1024) << " / " << memory_cap_ / (1024 * 1024) << " MB";
+	return report.str();
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "BlockCompression.h"
+
+class ThreadPool;
+
+// Streams 8 bit material textures into GPU memory mip by mip. A BCn container (<name>.btex, see
+// tools/TextureCompress) next to the image is used in its place, with its precomputed mips.
+// Images are decoded and their mip chain is built on a thread pool, new levels are uploaded through a pixel
+// buffer so the copy to the GPU doesn't block the GL thread. The GL texture starts out as the mip
+// tail (every level up to kMipTailSize) and grows one level per step towards the level its screen-space
+// footprint needs, while the total stays below a GPU memory cap. Textures that are over-resident give their
+// top level back when something with a larger deficit needs the memory.
+// Growing or shrinking reallocates the immutable storage and copies the resident levels over, so the GL name
+// changes; always bind through the streamer.
+// Scalar material maps can be loaded channel-packed (LoadOrm) so the shader gets them with one fetch.
+class TextureStreamer
+{
+public:
+	using Handle = unsigned int;
+
+	// An image file or an encoded image that is already in memory, like the ones embedded in a .glb.
+	// `channel` is the channel LoadOrm takes from it. A source without either is a missing map.
+	struct Source {
+		Source() = default;
+		Source(const std::string& path, unsigned int channel = 0) : path(path), channel(channel) {}
+		Source(const char* path) : path(path) {}
+		Source(std::shared_ptr<const std::vector<unsigned char>> encoded, unsigned int channel = 0)
+			: encoded(std::move(encoded)), channel(channel) {}
+
+		bool Empty() const { return path.empty() && !encoded; }
+
+		std::string path;
+		std::shared_ptr<const std::vector<unsigned char>> encoded;
+		unsigned int channel = 0;
+		// Value LoadOrm fills in when the map is missing, negative for BlockCompression::PackOrm's default
+		int neutral = -1;
+	};
+
+	static const unsigned int kMipTailSize = 64;
+
+	// `memory_cap` is the GPU memory all streamed textures may use, `upload_budget` the bytes uploaded per Update()
+	TextureStreamer(ThreadPool& pool, size_t memory_cap, size_t upload_budget);
+	~TextureStreamer();
+
+	// Starts decoding in the background, the texture binds as 0 until its mip tail is resident
+	Handle Load(const std::string& path, bool flip_vertically = true);
+	// Same for an encoded image in memory, `name` is only used in the report
+	Handle LoadEncoded(const std::string& name, std::shared_ptr<const std::vector<unsigned char>> encoded, bool flip_vertically = true);
+	// Occlusion, roughness and metallic packed into the R, G and B channels of one texture. `packed_path` is an
+	// offline packed container (TextureCompress orm), when it doesn't exist the maps are packed while decoding.
+	// Missing maps and maps that fail to decode are filled with their source's neutral value, see BlockCompression::PackOrm.
+	// Only when every map fails does the texture stay at 0.
+	Handle LoadOrm(const std::string& packed_path, const Source& occlusion, const Source& roughness,
+		const Source& metallic, bool flip_vertically = true);
+	void Bind(Handle handle, unsigned int slot) const;
+	// Current GL name, changes whenever the texture grows or shrinks
+	unsigned int Id(Handle handle) const;
+
+	// Number of screen pixels the texture's 0..1 UV range covers this frame, selects the mip level that is needed.
+	// Textures without a footprint want their full resolution.
+	void SetFootprint(Handle handle, float pixels);
+
+	// Creates mip tails for freshly decoded textures and streams levels in or out, call once per frame on the GL thread
+	void Update();
+
+	// True once every loaded image is decoded and its mip tail is resident
+	bool TailsResident() const;
+	// Decode time of all images added up, compare with the wall clock time to see what the pool saves
+	double DecodeMilliseconds() const;
+
+	size_t ResidentBytes() const;
+	size_t ResidentBytes(Handle handle) const;
+	// One line per texture with its resident and wanted level and resident bytes
+	std::string Report() const;
+
+	// Diameter in pixels of a sphere of `radius` around `center`, a cheap footprint estimate for SetFootprint
+	static float ProjectedSize(const glm::vec3& center, float radius, const glm::vec3& eye, float fov_y_radians, float viewport_height);
+
+private:
+	// Pixels hold the compressed blocks for BCn textures
+	using Mip = BlockCompression::Image;
+
+	struct Decoded {
+		double milliseconds = 0.0;
+		unsigned int internal_format = 0;
+		bool compressed = false;
+		std::vector<Mip> mips;
+	};
+
+	struct Entry {
+		std::string path;
+		std::future<Decoded> decoding;
+		unsigned int internal_format = 0;
+		bool compressed = false;
+		std::vector<Mip> mips;
+
+		unsigned int id = 0;
+		// Finest level on the GPU, mips.size() while nothing is resident
+		unsigned int resident_mip = 0;
+		unsigned int wanted_mip = 0;
+		size_t resident_bytes = 0;
+		double decode_milliseconds = 0.0;
+	};
+
+	ThreadPool& pool_;
+	unsigned int upload_pbo_ = 0;
+	size_t memory_cap_;
+	size_t upload_budget_;
+	size_t resident_bytes_ = 0;
+	std::vector<std::unique_ptr<Entry>> entries_;
+
+	static Decoded Decode(const Source& source, bool flip_vertically);
+	static Decoded DecodeOrm(const std::string& packed_path, const Source sources[3], bool flip_vertically);
+	static bool DecodeCompressed(const std::string& path, Decoded& decoded);
+	static bool DecodeImage(const Source& source, bool flip_vertically, Mip& image);
+	Handle Add(const std::string& path, std::future<Decoded> decoding);
+	size_t LevelBytes(const Entry& entry, unsigned int first_mip) const;
+	void Reallocate(Entry& entry, unsigned int first_mip);
+	unsigned int MipTailLevel(const Entry& entry) const;
+};
@@ -0,0 +1,45 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int thread_count)
+{
+	thread_count = std::max(1u, thread_count);
+	for (unsigned int i = 0; i < thread_count; ++i) {
+		workers_.emplace_back(&ThreadPool::Work, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	condition_.notify_all();
+	for (std::thread& worker : workers_) {
+		worker.join();
+	}
+}
+
+unsigned int ThreadPool::Size() const
+{
+	return static_cast<unsigned int>(workers_.size());
+}
+
+void ThreadPool::Work()
+{
+	for (;;) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			condition_.wait(lock, [this]() { return stopping_ || !jobs_.empty(); });
+			if (jobs_.empty()) {
+				return;
+			}
+			job = std::move(jobs_.front());
+			jobs_.pop_front();
+		}
+		job();
+	}
+}
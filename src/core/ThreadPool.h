@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads for background jobs (image decoding, cache IO).
+// Jobs run in submission order as soon as a worker is free.
+class ThreadPool
+{
+public:
+	explicit ThreadPool(unsigned int thread_count);
+	// Waits for the jobs that are already queued
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	template<typename Func>
+	std::future<std::invoke_result_t<Func>> Submit(Func&& fn)
+	{
+		// std::function needs a copyable target, so the task lives behind a shared_ptr
+		auto task = std::make_shared<std::packaged_task<std::invoke_result_t<Func>()>>(std::forward<Func>(fn));
+		std::future<std::invoke_result_t<Func>> result = task->get_future();
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			jobs_.emplace_back([task]() { (*task)(); });
+		}
+		condition_.notify_one();
+		return result;
+	}
+
+	unsigned int Size() const;
+
+private:
+	std::vector<std::thread> workers_;
+	std::deque<std::function<void()>> jobs_;
+	std::mutex mutex_;
+	std::condition_variable condition_;
+	bool stopping_ = false;
+
+	void Work();
+};
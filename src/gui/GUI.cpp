@@ -82,6 +82,38 @@ void GUI::Draw(bool& on_change)
 		ImGuiFileDialog::Instance()->Close();
 	}
 
+	// Switching the irradiance representation needs a different bake
+	if (ImGui::Checkbox("SH irradiance", &settings_->sh_irradiance)) {
+		on_change = true;
+	}
+	if (ImGui::Checkbox("Compute prefilter", &settings_->compute_prefilter)) {
+		on_change = true;
+	}
+	// Metallic by row and roughness by column, for look-dev
+	ImGui::Checkbox("Sphere grid", &settings_->sphere_grid);
+	// Small lights over the floor on top of the four key lights, culled per froxel
+	ImGui::SliderInt("Point lights", &settings_->point_lights, 0, 4096);
+	// G-buffer plus one lighting pass instead of shading every fragment forward
+	ImGui::Checkbox("Deferred shading", &settings_->deferred);
+	// Depth of all draws first, then each pixel is shaded once with GL_EQUAL
+	ImGui::Checkbox("Depth pre-pass", &settings_->depth_prepass);
+	// Draws whose bounds are outside the view are dropped on the CPU before they are submitted
+	ImGui::Checkbox("Frustum culling", &settings_->frustum_culling);
+
+	// Resident GPU memory of the streamed material textures
+	ImGui::Separator();
+	ImGui::TextUnformatted(settings_->texture_report.c_str());
+	// Occupancy of the shared mesh buffers
+	ImGui::Separator();
+	ImGui::TextUnformatted(settings_->mesh_report.c_str());
+	ImGui::TextUnformatted(settings_->draw_report.c_str());
+	ImGui::TextUnformatted(settings_->light_report.c_str());
+	ImGui::TextUnformatted(settings_->timing_report.c_str());
+	ImGui::TextUnformatted(settings_->ibl_report.c_str());
+	ImGui::TextUnformatted(settings_->bvh_report.c_str());
+	// Object under the cursor while it is free (hold Z)
+	ImGui::TextUnformatted(settings_->pick_report.c_str());
+
 	ImGui::End();
 }
 
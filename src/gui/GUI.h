@@ -14,6 +14,21 @@ struct Settings {
 	std::string ibl_map_path = "";
 	std::string display_ibl_path = "";
 	std::string model_path = "";
+	bool sh_irradiance = true;
+	bool compute_prefilter = false;
+	bool sphere_grid = false;
+	int point_lights = 0;
+	bool deferred = false;
+	bool depth_prepass = true;
+	bool frustum_culling = true;
+	std::string texture_report = "";
+	std::string mesh_report = "";
+	std::string draw_report = "";
+	std::string light_report = "";
+	std::string timing_report = "";
+	std::string bvh_report = "";
+	std::string pick_report = "";
+	std::string ibl_report = "";
 };
 
 class GUI
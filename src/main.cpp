@@ -1,11 +1,20 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
 #include <iostream>
 #include <vector>
 #include <memory>
+#include <sstream>
+#include <string>
 
+#include "opengl/GpuTimer.h"
 #include "opengl/Shader.h"
+#include "opengl/ShaderVariants.h"
+#include "opengl/StreamBuffer.h"
 #include "opengl/VertexArray.h"
 #include "opengl/VertexBuffer.h"
 #include "opengl/IndexBuffer.h"
@@ -21,6 +30,20 @@
 #include "gui/GUI.h"
 #include "core/Renderer.h"
 #include "core/Ibl.h"
+#include "core/EnvironmentLoader.h"
+#include "core/IblCache.h"
+#include "core/TextureStreamer.h"
+#include "core/Model.h"
+#include "core/RenderQueue.h"
+#include "core/Bvh.h"
+#include "core/FrameData.h"
+#include "core/FrustumCuller.h"
+#include "core/GBuffer.h"
+#include "core/LightClusters.h"
+#include "core/PbrFeatures.h"
+#include "core/ShaderWatcher.h"
+#include "core/ThreadPool.h"
+#include "core/Parallel.h"
 
 /* CONSTANTS */
 // 1 640*480
@@ -47,9 +70,7 @@ Renderer renderer;
 bool on_change = false;
 
 // IBL
-unsigned int env_cubemap = 0;
-unsigned int irradiance_map = 0;
-unsigned int prefilter_map = 0;
+Ibl::EnvironmentMaps ibl_maps;
 unsigned int brdf_lut_texture = 0;
 
 bool firstMouse = true;
@@ -58,6 +79,9 @@ float pitch = 0.0f;
 float lastX = kWidth / 2.0;
 float lastY = kHeight / 2.0;
 float fov = 45.0f;
+// Cursor position to pick the scene object under, set while the cursor is free
+bool pick_requested = false;
+glm::vec2 pick_cursor = glm::vec2(0.0f);
 
 // timing
 float delta_time = 0.0f;	// time between current frame and last frame
@@ -66,8 +90,14 @@ float last_frame = 0.0f;
 // TODO: Check whether there is a model that can be rendered
 bool model_avaliable = false;
 
-int main(void)
+int main(int argc, char** argv)
 {
+	// Wall clock time of each startup stage since entering main
+	auto startup_begin = std::chrono::steady_clock::now();
+	auto startup_milliseconds = [&]() {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startup_begin).count();
+	};
+
 	GLFWwindow* window;
 
 	/* Initialize the library */
@@ -102,6 +132,8 @@ int main(void)
 		std::cout << "ERROR::GLAD::FAILED_TO_INITIALIZE_OPENGL_CONTEXT" << std::endl;
 		return -1;
 	}
+	std::cout << "STARTUP::CONTEXT " << startup_milliseconds() << " ms" << std::endl;
+	Shader::EnableParallelCompile((GLADloadproc)glfwGetProcAddress);
 
 #ifdef _DEBUG
 	//glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, true);
@@ -122,7 +154,8 @@ int main(void)
 	/* Configure global OpenGL state */
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LEQUAL);
-	//glEnable(GL_CULL_FACE);
+	// Back-face culling is enabled by RenderQueue for the scene only, the skybox and the IBL bakes look at
+	// their cubes from inside
 
 	/* GLFW Callbacks */
 	glfwSetErrorCallback(ErrorCallback);
@@ -142,101 +175,167 @@ int main(void)
 #endif
 
 	/* Load shaders */
-	Shader shader("shaders/pbr.vert", "shaders/pbr.frag");
+	// Occlusion, roughness and metallic come from one packed texture, see TextureStreamer::LoadOrm. The variants
+	// are keyed by PbrFeatures and compiled the first time a material or frame setting needs them.
+	const std::vector<std::string> pbr_flag_names(std::begin(PbrFeatures::kFlagNames), std::end(PbrFeatures::kFlagNames));
+	ShaderVariants pbr_variants("shaders/pbr.vert", "shaders/pbr.frag", { "USE_ORM_MAP" }, pbr_flag_names);
+	// The deferred path splits pbr.frag: gbuffer.frag keeps the material keys, deferred.frag the frame keys
+	ShaderVariants gbuffer_variants("shaders/pbr.vert", "shaders/gbuffer.frag", { "USE_ORM_MAP" }, pbr_flag_names);
+	ShaderVariants deferred_variants("shaders/deferred.vert", "shaders/deferred.frag", {}, pbr_flag_names);
 	Shader equirectangularToCubemapShader("shaders/hdrmap.vert", "shaders/hdrmap.frag");
 	Shader irradiance_shader("shaders/irradiance.vert", "shaders/irradiance.frag");
 	Shader prefilter_shader("shaders/irradiance.vert", "shaders/prefilter.frag");
-	Shader brdf_shader("shaders/brdf.vert", "shaders/brdf.frag");
+	Shader prefilter_compute_shader("shaders/prefilter.comp");
 	Shader skyboxShader("shaders/skybox.vert", "shaders/skybox.frag");
-
-	shader.Bind();
-	shader.SetInt("irradiance_map", 0);
-	shader.SetInt("prefilter_map", 1);
-	shader.SetInt("brdfLUT", 2);
-
-	// Material textures
-	shader.SetInt("albedoMap", 3);
-	shader.SetInt("normalMap", 4);
-	shader.SetInt("metallicMap", 5);
-	shader.SetInt("roughnessMap", 6);
-
-	//shader.SetVec3f("albedo", 0.5f, 0.0f, 0.0f);
-	shader.SetFloat("ao", 1.0f);
-
-	equirectangularToCubemapShader.Bind();
-	equirectangularToCubemapShader.SetInt("equirectangularMap", 0);
-
-	skyboxShader.Bind();
-	skyboxShader.SetInt("environmentMap", 0);
+	Shader depth_shader("shaders/depth.vert", "shaders/depth.frag");
+	// Only submitted, the driver compiles them while the textures and the model below load
+	Shader* programs[] = { &equirectangularToCubemapShader, &irradiance_shader, &prefilter_shader,
+		&prefilter_compute_shader, &skyboxShader, &depth_shader };
+	std::cout << "STARTUP::SHADERS_SUBMITTED " << startup_milliseconds() << " ms" << std::endl;
+	// Edited shaders and their includes are rebuilt in the background and swapped in without a restart
+	ShaderWatcher shader_watcher;
+	for (Shader* program : programs) {
+		shader_watcher.Watch(*program);
+	}
 
 	// lights
 	// ------
-	glm::vec3 lightPositions[] = {
-		glm::vec3(-10.0f,  10.0f, 10.0f),
-		glm::vec3(10.0f,  10.0f, 10.0f),
-		glm::vec3(-10.0f, -10.0f, 10.0f),
-		glm::vec3(10.0f, -10.0f, 10.0f),
-	};
-	glm::vec3 lightColors[] = {
-		glm::vec3(300.0f, 300.0f, 300.0f),
-		glm::vec3(300.0f, 300.0f, 300.0f),
-		glm::vec3(300.0f, 300.0f, 300.0f),
-		glm::vec3(300.0f, 300.0f, 300.0f)
+	// The four key lights reach the whole scene, the GUI adds small orbiting ones over the floor on top
+	const float kKeyLightRange = 60.0f;
+	const LightClusters::PointLight key_lights[] = {
+		{ glm::vec3(-10.0f,  10.0f, 10.0f), glm::vec3(300.0f, 300.0f, 300.0f), kKeyLightRange },
+		{ glm::vec3(10.0f,  10.0f, 10.0f), glm::vec3(300.0f, 300.0f, 300.0f), kKeyLightRange },
+		{ glm::vec3(-10.0f, -10.0f, 10.0f), glm::vec3(300.0f, 300.0f, 300.0f), kKeyLightRange },
+		{ glm::vec3(10.0f, -10.0f, 10.0f), glm::vec3(300.0f, 300.0f, 300.0f), kKeyLightRange },
 	};
+	std::vector<LightClusters::PointLight> scene_lights;
+	LightClusters light_clusters;
 	int nrRows = 7;
 	int nrColumns = 7;
 	float spacing = 2.5;
+	std::vector<RenderQueue::Instance> sphere_grid;
+	sphere_grid.reserve(nrRows * nrColumns);
+	auto sphere_grid_transform = [&](int row, int col) {
+		return glm::translate(glm::mat4(1.0f), glm::vec3((col - nrColumns / 2) * spacing, (row - nrRows / 2) * spacing, 0.0f));
+	};
+	glm::mat4 floor_transform = glm::scale(glm::mat4(1.0f), glm::vec3(10.0f, 1.0f, 10.0f));
+	floor_transform = glm::rotate(floor_transform, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+	floor_transform = glm::translate(floor_transform, glm::vec3(0.0f, 0.0f, 2.0f));
+	const glm::mat4 external_model_transform = glm::translate(glm::mat4(1.0f), glm::vec3(3.0f, 0.0f, 0.0f));
+
+	// The floor, the spheres and the model for culling and picking, rebuilt when the grid is toggled
+	Bvh scene_bvh;
+	std::vector<Aabb> scene_bounds;
+	std::vector<std::string> scene_names;
+	std::vector<unsigned int> scene_query;
+	std::vector<unsigned char> scene_visible;
+	int scene_layout = -1;
+	// Light ranges, refit every frame as the small lights orbit and rebuilt when their number changes
+	Bvh light_bvh;
+	std::vector<unsigned int> light_query;
+	std::vector<LightClusters::PointLight> visible_lights;
 
-	/* Load models */
-	/*Model external_model("res/models/AntiqueCamera/glTF/AntiqueCamera.gltf");*/
 
 	/* Add textures here */
-	Texture2D hdr_map("res/textures/hdr/satara_night_no_lamps_1k.hdr", GL_RGBA16F);
-	// Load PBR Material textures
-	Texture2D albedo_map("res/textures/Aluminum-Scuffed_Unreal-Engine/Aluminum-Scuffed_basecolor.png");
-	Texture2D normal_map("res/textures/Aluminum-Scuffed_Unreal-Engine/Aluminum-Scuffed_normal.png");
-	Texture2D metallic_map("res/textures/Aluminum-Scuffed_Unreal-Engine/Aluminum-Scuffed_metallic.png");
-	Texture2D roughness_map("res/textures/Aluminum-Scuffed_Unreal-Engine/Aluminum-Scuffed_roughness.png");
-
-	Texture2D floor_albedo_map("res/textures/oxidized-copper-ue/oxidized-copper-albedo.png");
-	Texture2D floor_normal_map("res/textures/oxidized-copper-ue/oxidized-copper-normal-ue.png");
-	Texture2D floor_metallic_map("res/textures/oxidized-copper-ue/oxidized-copper-metal.png");
-	Texture2D floor_roughness_map("res/textures/oxidized-copper-ue/oxidized-coppper-roughness.png");
-
-	// Convert equirectangular map to cubemap
-	unsigned int capture_fbo = 0, capture_rbo = 0;
-	glm::mat4 capture_projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
-	glm::mat4 capture_views[] =
-	{
-	   glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-	   glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-	   glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  1.0f,  0.0f), glm::vec3(0.0f,  0.0f,  1.0f)),
-	   glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f,  0.0f), glm::vec3(0.0f,  0.0f, -1.0f)),
-	   glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  0.0f,  1.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-	   glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  0.0f, -1.0f), glm::vec3(0.0f, -1.0f,  0.0f))
+	// Images and the environment are decoded concurrently on the pool, one hardware thread is left to the GL thread
+	ThreadPool thread_pool(Parallel::ThreadCount() > 1 ? Parallel::ThreadCount() - 1 : 1);
+
+	// Environment maps are decoded and baked in the background, see EnvironmentLoader. The first one is
+	// waited for since there is nothing to show without it, later switches are spread over frames.
+	const double kEnvironmentBudgetMs = 4.0;
+	Ibl::BakeSettings bake_settings;
+	EnvironmentLoader environment_loader(equirectangularToCubemapShader, irradiance_shader, prefilter_shader, prefilter_compute_shader, renderer, thread_pool);
+	// SH irradiance is the only frame-wide flag, the material flags come from each draw
+	auto pbr_frame_key = [&]() {
+		return bake_settings.sh_irradiance ? static_cast<unsigned int>(PbrFeatures::kShIrradiance) : 0u;
+	};
+	// The fully textured variant is what the built-in scene draws, it compiles alongside the programs above
+	pbr_variants.Prepare(PbrFeatures::kMaterialMask | pbr_frame_key());
+	auto init_lighting = [&](Shader& variant) {
+		variant.SetInt("irradianceMap", 0);
+		variant.SetInt("prefilterMap", 1);
+		variant.SetInt("brdfLUT", 2);
+		variant.SetVec3fArray("shIrradiance", ibl_maps.irradiance_sh.data(), static_cast<int>(ibl_maps.irradiance_sh.size()));
+	};
+	auto init_material = [&](Shader& variant) {
+		variant.SetInt("albedoMap", 3);
+		variant.SetInt("normalMap", 4);
+		variant.SetInt("ormMap", 5);
 	};
+	pbr_variants.SetInitializer([&](Shader& variant) {
+		init_lighting(variant);
+		init_material(variant);
+		shader_watcher.Watch(variant);
+	});
+	gbuffer_variants.SetInitializer([&](Shader& variant) {
+		init_material(variant);
+		shader_watcher.Watch(variant);
+	});
+	deferred_variants.SetInitializer([&](Shader& variant) {
+		init_lighting(variant);
+		variant.SetInt("gAlbedo", GBuffer::kFirstTextureSlot);
+		variant.SetInt("gNormal", GBuffer::kFirstTextureSlot + 1);
+		variant.SetInt("gOrm", GBuffer::kFirstTextureSlot + 2);
+		variant.SetInt("gDepth", GBuffer::kFirstTextureSlot + 3);
+		shader_watcher.Watch(variant);
+	});
+	auto apply_environment = [&]() {
+		auto set_sh = [&](Shader& variant) {
+			variant.SetVec3fArray("shIrradiance", ibl_maps.irradiance_sh.data(), static_cast<int>(ibl_maps.irradiance_sh.size()));
+		};
+		pbr_variants.ForEach(set_sh);
+		deferred_variants.ForEach(set_sh);
+	};
+
+	environment_loader.Request("res/textures/hdr/satara_night_no_lamps_1k.hdr", bake_settings);
+
+	// Load PBR Material textures, they are streamed in starting from their mip tails
+	const size_t kTextureMemoryCap = 128 * 1024 * 1024;
+	const size_t kTextureUploadBudget = 8 * 1024 * 1024;
+	TextureStreamer texture_streamer(thread_pool, kTextureMemoryCap, kTextureUploadBudget);
+	TextureStreamer::Handle albedo_map = texture_streamer.Load("res/textures/Aluminum-Scuffed_Unreal-Engine/Aluminum-Scuffed_basecolor.png");
+	TextureStreamer::Handle normal_map = texture_streamer.Load("res/textures/Aluminum-Scuffed_Unreal-Engine/Aluminum-Scuffed_normal.png");
+	TextureStreamer::Handle orm_map = texture_streamer.LoadOrm("res/textures/Aluminum-Scuffed_Unreal-Engine/Aluminum-Scuffed_orm.btex", "",
+		"res/textures/Aluminum-Scuffed_Unreal-Engine/Aluminum-Scuffed_roughness.png", "res/textures/Aluminum-Scuffed_Unreal-Engine/Aluminum-Scuffed_metallic.png");
+
+	TextureStreamer::Handle floor_albedo_map = texture_streamer.Load("res/textures/oxidized-copper-ue/oxidized-copper-albedo.png");
+	TextureStreamer::Handle floor_normal_map = texture_streamer.Load("res/textures/oxidized-copper-ue/oxidized-copper-normal-ue.png");
+	TextureStreamer::Handle floor_orm_map = texture_streamer.LoadOrm("res/textures/oxidized-copper-ue/oxidized-copper-orm.btex", "",
+		"res/textures/oxidized-copper-ue/oxidized-coppper-roughness.png", "res/textures/oxidized-copper-ue/oxidized-copper-metal.png");
+	const TextureStreamer::Handle sphere_textures[] = { albedo_map, normal_map, orm_map };
+	const TextureStreamer::Handle floor_textures[] = { floor_albedo_map, floor_normal_map, floor_orm_map };
+
+	/* Load models */
+	// An optional .gltf/.glb from the command line, drawn next to the sphere. Its images stream in like the ones above.
+	std::unique_ptr<Model> external_model;
+	if (argc > 1) {
+		external_model = std::make_unique<Model>(argv[1], texture_streamer, renderer.Arena());
+	}
+
+	for (Shader* program : programs) {
+		program->Finish();
+	}
+	std::cout << "STARTUP::SHADERS " << startup_milliseconds() << " ms" << std::endl;
 
-	env_cubemap = Ibl::CubemapFromHDRI("res/textures/hdr/satara_night_no_lamps_1k.hdr", capture_fbo, capture_rbo, equirectangularToCubemapShader, capture_projection, capture_views, renderer);
+	//shader.SetVec3f("albedo", 0.5f, 0.0f, 0.0f);
 
-	// pbr: create an irradiance cubemap, and re-scale capture FBO to irradiance scale.
-	// --------------------------------------------------------------------------------
-	irradiance_map = Ibl::CreateIrradianceMap(capture_fbo, capture_fbo, irradiance_shader, env_cubemap, capture_projection, capture_views, renderer);
+	equirectangularToCubemapShader.SetInt("equirectangularMap", 0);
+	skyboxShader.SetInt("environmentMap", 0);
 
-	// pbr: create a pre-filter cubemap, and re-scale capture FBO to pre-filter scale.
-	// --------------------------------------------------------------------------------
-	prefilter_map = Ibl::CreatePrefilterMap(capture_fbo, capture_fbo, prefilter_shader, env_cubemap, capture_projection, capture_views, renderer);
+	if (environment_loader.Finish(ibl_maps, bake_settings)) {
+		apply_environment();
+	}
+	std::cout << "STARTUP::ENVIRONMENT " << startup_milliseconds() << " ms" << std::endl;
 
-	// pbr: generate a 2D LUT from the BRDF equations used.
-	// ----------------------------------------------------
-	brdf_lut_texture = Ibl::CreateBRDFLookupTexture(capture_fbo, capture_rbo, brdf_shader, renderer);
+	// pbr: the 2D LUT from the BRDF equations doesn't depend on the environment, upload the precomputed one once.
+	// ------------------------------------------------------------------------------------------------------------
+	brdf_lut_texture = Ibl::CreateBRDFLookupTexture();
 
 	// initialize static shader uniforms before rendering
 	// --------------------------------------------------
-	glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)kWidth / (float)kHeight, 0.1f, 100.0f);
-	shader.Bind();
-	shader.SetMat4f("projection", projection);
-	skyboxShader.Bind();
-	skyboxShader.SetMat4f("projection", projection);
+	const float kNearPlane = 0.1f;
+	const float kFarPlane = 100.0f;
+	glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)kWidth / (float)kHeight, kNearPlane, kFarPlane);
 
 	// then before rendering, configure the viewport to the original framebuffer's screen dimensions
 	int w, h;
@@ -245,14 +344,29 @@ int main(void)
 
 	/* Initialize GUI */
 	GUI gui(window);
-
-	Renderer renderer;
+	gui.settings_->ibl_map_path = "res/textures/hdr/satara_night_no_lamps_1k.hdr";
+	gui.settings_->display_ibl_path = "satara_night_no_lamps_1k.hdr";
+	gui.settings_->sh_irradiance = bake_settings.sh_irradiance;
+	gui.settings_->compute_prefilter = bake_settings.backend == Ibl::Backend::Compute;
+
+	// Uniform blocks, draw data and indirect commands of the frames in flight
+	const size_t kStreamFrameSize = 1024 * 1024;
+	StreamBuffer stream_buffer(kStreamFrameSize);
+	// Every pbr draw of a frame goes through the queue, one multi-draw per variant and texture set
+	RenderQueue render_queue(renderer.Arena(), stream_buffer);
+	FrameData frame_data;
+	GBuffer gbuffer;
+	// Scene passes only, from the first draw to the end of the lighting pass
+	GpuTimer scene_timer;
+	bool textures_reported = false;
+	std::cout << "STARTUP::FIRST_FRAME " << startup_milliseconds() << " ms" << std::endl;
 	/* Loop until the user closes the window */
 	while (!glfwWindowShouldClose(window))
 	{
 		float current_frame = glfwGetTime();
 		delta_time = current_frame - last_frame;
 		last_frame = current_frame;
+		shader_watcher.Update(current_frame);
 
 		/* Render here */
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -261,79 +375,246 @@ int main(void)
 		// Start the ImGui frame
 		gui.Initialize();
 
-		shader.Bind();
-		glm::mat4 model = glm::mat4(1.0f);
+		// The Frame block is shared by the pbr and skybox programs and stays bound for the whole frame
+		stream_buffer.BeginFrame();
 		glm::mat4 view = camera.GetViewMatrix();
-		shader.SetMat4f("view", view);
-		shader.SetVec3f("camPos", camera.Position);
-
-		// Bind Material textures
-		floor_albedo_map.Bind(3);
-		floor_normal_map.Bind(4);
-		floor_metallic_map.Bind(5);
-		floor_roughness_map.Bind(6);
-
-		model = glm::scale(model, glm::vec3(10.0f, 1.0f, 10.0f));
-		model = glm::rotate(model, (float)glm::radians(90.f), glm::vec3(1.0, 0.0, 0.0));
-		model = glm::translate(model, glm::vec3(0.0f, 0.0f, 2.0f));
-		shader.SetMat4f("view", view);
-		shader.SetMat4f("model", model);
-		renderer.DrawCube();
+		glfwGetFramebufferSize(window, &w, &h);
+
+		// Lights are culled into the froxel grid of this frame's camera
+		scene_lights.assign(std::begin(key_lights), std::end(key_lights));
+		for (int i = 0; i < gui.settings_->point_lights; ++i) {
+			// Golden angle spiral over the floor, slowly turning
+			float t = (i + 0.5f) / gui.settings_->point_lights;
+			float angle = i * 2.39996f + current_frame * 0.25f;
+			float radius = 12.0f * std::sqrt(t);
+			float hue = glm::fract(i * 0.618034f);
+			LightClusters::PointLight light;
+			light.position = glm::vec3(radius * std::cos(angle), -1.5f + 0.5f * std::sin(i * 1.7f), radius * std::sin(angle));
+			light.color = 4.0f * glm::clamp(glm::abs(glm::fract(glm::vec3(hue) + glm::vec3(0.0f, 2.0f / 3.0f, 1.0f / 3.0f)) * 6.0f - 3.0f) - 1.0f, 0.0f, 1.0f);
+			light.range = 3.0f;
+			scene_lights.push_back(light);
+		}
+		// Only lights whose range reaches into the view go into the grid
+		Frustum frustum = Frustum::FromMatrix(projection * view);
+		bool culling = gui.settings_->frustum_culling;
+		auto light_bounds = [](const LightClusters::PointLight& light) {
+			return Aabb{ light.position - glm::vec3(light.range), light.position + glm::vec3(light.range) };
+		};
+		if (light_bvh.ObjectCount() != scene_lights.size()) {
+			std::vector<Aabb> bounds(scene_lights.size());
+			std::transform(scene_lights.begin(), scene_lights.end(), bounds.begin(), light_bounds);
+			light_bvh.Build(bounds);
+		}
+		else {
+			for (size_t i = std::size(key_lights); i < scene_lights.size(); ++i) {
+				light_bvh.Update(static_cast<unsigned int>(i), light_bounds(scene_lights[i]));
+			}
+			light_bvh.Refit();
+		}
+		if (culling) {
+			light_query.clear();
+			light_bvh.Query(frustum, light_query);
+			std::sort(light_query.begin(), light_query.end());
+			visible_lights.clear();
+			for (unsigned int light : light_query) {
+				visible_lights.push_back(scene_lights[light]);
+			}
+		}
+		light_clusters.Build(culling ? visible_lights : scene_lights, view, projection, kNearPlane, kFarPlane, w, h);
+		light_clusters.Upload(stream_buffer);
+		gui.settings_->light_report = light_clusters.Report();
+
+		frame_data.view = view;
+		frame_data.projection = projection;
+		frame_data.inverse_view_projection = glm::inverse(projection * view);
+		frame_data.camera_position = glm::vec4(camera.Position, 1.0f);
+		frame_data.cluster_size = light_clusters.GridSize();
+		frame_data.cluster_params = light_clusters.GridParams();
+		size_t frame_offset = stream_buffer.Write(&frame_data, sizeof(FrameData));
+		stream_buffer.BindRange(GL_UNIFORM_BUFFER, FrameData::kFrameBinding, frame_offset, sizeof(FrameData));
+
+		// Stream material mips by screen-space footprint. The sphere's UVs wrap around it, so its textures
+		// span about twice its projected diameter, the floor is a single 20x20 face.
+		float fov_y = glm::radians(camera.Zoom);
+		float sphere_footprint = 2.0f * TextureStreamer::ProjectedSize(glm::vec3(0.0f), 1.0f, camera.Position, fov_y, static_cast<float>(h));
+		float floor_footprint = TextureStreamer::ProjectedSize(glm::vec3(0.0f, -2.0f, 0.0f), 10.0f, camera.Position, fov_y, static_cast<float>(h));
+		for (TextureStreamer::Handle texture : sphere_textures) {
+			texture_streamer.SetFootprint(texture, sphere_footprint);
+		}
+		for (TextureStreamer::Handle texture : floor_textures) {
+			texture_streamer.SetFootprint(texture, floor_footprint);
+		}
+		texture_streamer.Update();
+		if (!textures_reported && texture_streamer.TailsResident()) {
+			std::cout << "STARTUP::TEXTURES " << startup_milliseconds() << " ms (" << texture_streamer.DecodeMilliseconds()
+				<< " ms of decoding on " << thread_pool.Size() << " threads)" << std::endl;
+			textures_reported = true;
+		}
+		gui.settings_->texture_report = texture_streamer.Report();
+		gui.settings_->mesh_report = renderer.Arena().Report();
+		gui.settings_->ibl_report = IblCache::Report();
+
+		// Material textures, the built-in materials have no factors
+		RenderQueue::Material floor_material;
+		RenderQueue::Material sphere_material;
+		// Maps that aren't resident yet or failed to load are left out of the variant instead of sampling texture 0
+		for (unsigned int i = 0; i < RenderQueue::kTextureCount; ++i) {
+			floor_material.textures[i] = texture_streamer.Id(floor_textures[i]);
+			sphere_material.textures[i] = texture_streamer.Id(sphere_textures[i]);
+			if (floor_material.textures[i] != 0) {
+				floor_material.variant |= PbrFeatures::kMapFlags[i];
+			}
+			if (sphere_material.textures[i] != 0) {
+				sphere_material.variant |= PbrFeatures::kMapFlags[i];
+			}
+		}
 
-		model = glm::mat4(1.0f);
+		// Objects: the floor, then the spheres row by row, then the model
+		int layout = gui.settings_->sphere_grid ? 1 : 0;
+		if (layout != scene_layout) {
+			scene_bounds.assign(1, renderer.CubeBounds().Transformed(floor_transform));
+			scene_names.assign(1, "floor");
+			if (gui.settings_->sphere_grid) {
+				for (int row = 0; row < nrRows; ++row) {
+					for (int col = 0; col < nrColumns; ++col) {
+						scene_bounds.push_back(renderer.SphereBounds().Transformed(sphere_grid_transform(row, col)));
+						scene_names.push_back("sphere " + std::to_string(row) + ", " + std::to_string(col));
+					}
+				}
+			}
+			else {
+				scene_bounds.push_back(renderer.SphereBounds());
+				scene_names.push_back("sphere");
+			}
+			if (external_model && external_model->IsLoaded()) {
+				scene_bounds.push_back(external_model->Bounds().Transformed(external_model_transform));
+				scene_names.push_back(argv[1]);
+			}
+			scene_bvh.Build(scene_bounds);
+			scene_layout = layout;
+		}
+		scene_visible.assign(scene_bounds.size(), culling ? 0 : 1);
+		if (culling) {
+			scene_query.clear();
+			scene_bvh.Query(frustum, scene_query);
+			for (unsigned int object : scene_query) {
+				scene_visible[object] = 1;
+			}
+		}
+		gui.settings_->bvh_report = scene_bvh.Report() + "\n" + light_bvh.Report();
+
+		// The cursor is in window coordinates, which differ from the framebuffer's on high DPI displays
+		if (pick_requested) {
+			int window_width, window_height;
+			glfwGetWindowSize(window, &window_width, &window_height);
+			glm::vec2 ndc = glm::vec2(2.0f * pick_cursor.x / std::max(window_width, 1) - 1.0f, 1.0f - 2.0f * pick_cursor.y / std::max(window_height, 1));
+			glm::vec4 near_point = frame_data.inverse_view_projection * glm::vec4(ndc, -1.0f, 1.0f);
+			glm::vec4 far_point = frame_data.inverse_view_projection * glm::vec4(ndc, 1.0f, 1.0f);
+			glm::vec3 origin = glm::vec3(near_point) / near_point.w;
+			glm::vec3 direction = glm::normalize(glm::vec3(far_point) / far_point.w - origin);
+			Bvh::RayHit hit;
+			std::ostringstream pick_report;
+			if (scene_bvh.Raycast(origin, direction, kFarPlane, hit)) {
+				pick_report << "Picked: " << scene_names[hit.object] << " at " << std::fixed << std::setprecision(2) << hit.distance;
+			}
+			else {
+				pick_report << "Picked: nothing";
+			}
+			gui.settings_->pick_report = pick_report.str();
+			pick_requested = false;
+		}
 
-		// Bind Material textures
-		albedo_map.Bind(3);
-		normal_map.Bind(4);
-		metallic_map.Bind(5);
-		roughness_map.Bind(6);
+		size_t next_object = 0;
+		if (scene_visible[next_object++]) {
+			render_queue.Submit(renderer.CubeMesh(), renderer.CubeBounds(), floor_transform, render_queue.AddMaterial(floor_material));
+		}
 
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(0.0, 0.0, 0.0));
-		shader.SetMat4f("model", model);
-		renderer.DrawSphere();
+		if (gui.settings_->sphere_grid) {
+			// One instanced command for the whole grid, the materials share the sphere textures so they batch
+			sphere_grid.clear();
+			for (int row = 0; row < nrRows; ++row) {
+				for (int col = 0; col < nrColumns; ++col) {
+					if (!scene_visible[next_object++]) {
+						continue;
+					}
+					sphere_material.metallic_factor = static_cast<float>(row) / (nrRows - 1);
+					sphere_material.roughness_factor = glm::clamp(static_cast<float>(col) / (nrColumns - 1), 0.05f, 1.0f);
+
+					RenderQueue::Instance instance;
+					instance.transform = sphere_grid_transform(row, col);
+					instance.material = render_queue.AddMaterial(sphere_material);
+					sphere_grid.push_back(instance);
+				}
+			}
+			render_queue.SubmitInstanced(renderer.SphereMesh(), renderer.SphereBounds(), sphere_grid);
+		}
+		else if (scene_visible[next_object++]) {
+			render_queue.Submit(renderer.SphereMesh(), renderer.SphereBounds(), glm::mat4(1.0f), render_queue.AddMaterial(sphere_material));
+		}
 
+		if (external_model && external_model->IsLoaded() && scene_visible[next_object++]) {
+			external_model->Submit(render_queue, external_model_transform);
+		}
+		// the current maps stay bound until the loader has the complete new set
 		if (on_change) {
-			glDeleteTextures(1, &env_cubemap);
-			glDeleteTextures(1, &irradiance_map);
-			glDeleteTextures(1, &prefilter_map);
-			glDeleteTextures(1, &brdf_lut_texture);
-
-			glDeleteRenderbuffers(1, &capture_rbo);
-			glDeleteFramebuffers(1, &capture_fbo);
-
-			env_cubemap = Ibl::CubemapFromHDRI(gui.settings_->ibl_map_path, capture_fbo, capture_rbo, equirectangularToCubemapShader, capture_projection, capture_views, renderer);
-			irradiance_map = Ibl::CreateIrradianceMap(capture_fbo, capture_fbo, irradiance_shader, env_cubemap, capture_projection, capture_views, renderer);
-			prefilter_map = Ibl::CreatePrefilterMap(capture_fbo, capture_fbo, prefilter_shader, env_cubemap, capture_projection, capture_views, renderer);
-			brdf_lut_texture = Ibl::CreateBRDFLookupTexture(capture_fbo, capture_rbo, brdf_shader, renderer);
-
-			glfwGetWindowSize(window, &w, &h);
-			glViewport(0, 0, w, h);
-
-			//std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+			Ibl::BakeSettings requested_settings = bake_settings;
+			requested_settings.sh_irradiance = gui.settings_->sh_irradiance;
+			requested_settings.backend = gui.settings_->compute_prefilter ? Ibl::Backend::Compute : Ibl::Backend::Raster;
+			environment_loader.Request(gui.settings_->ibl_map_path, requested_settings);
 
 			on_change = false;
 		}
+		if (environment_loader.Update(kEnvironmentBudgetMs, ibl_maps, bake_settings)) {
+			apply_environment();
+		}
 
-		// bind pre-computed IBL data
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, irradiance_map);
+		// bind pre-computed IBL data, SH irradiance lives in uniforms and needs no cubemap
+		if (!bake_settings.sh_irradiance) {
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_CUBE_MAP, ibl_maps.irradiance_map);
+		}
 		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, prefilter_map);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, ibl_maps.prefilter_map);
 		glActiveTexture(GL_TEXTURE2);
 		glBindTexture(GL_TEXTURE_2D, brdf_lut_texture);
 
-		// Sphere rendering was here
+		// Forward shades every fragment drawn, deferred only writes the material and shades each pixel once
+		bool deferred = gui.settings_->deferred;
+		render_queue.SetEye(camera.Position);
+		render_queue.SetDepthPrepass(gui.settings_->depth_prepass ? &depth_shader : nullptr);
+		render_queue.SetFrustum(culling ? &frustum : nullptr);
+		scene_timer.Begin();
+		if (deferred) {
+			gbuffer.Begin(w, h);
+			render_queue.Flush(gbuffer_variants, 0);
+			gbuffer.End();
+
+			// Writes the G-buffer depth so the skybox is still tested against the scene
+			gbuffer.BindTextures();
+			glDepthFunc(GL_ALWAYS);
+			deferred_variants.Get(pbr_frame_key()).Bind();
+			renderer.DrawQuad();
+			glDepthFunc(GL_LEQUAL);
+		}
+		else {
+			render_queue.Flush(pbr_variants, pbr_frame_key());
+		}
+		scene_timer.End();
+		gui.settings_->draw_report = render_queue.Report();
+		std::ostringstream timing_report;
+		timing_report << "Scene GPU: " << std::fixed << std::setprecision(2) << scene_timer.Milliseconds() << " ms ("
+			<< (deferred ? "deferred" : "forward") << (gui.settings_->depth_prepass ? ", depth pre-pass" : "") << ")";
+		gui.settings_->timing_report = timing_report.str();
 
 		// Render Skybox
 		skyboxShader.Bind();
-		skyboxShader.SetMat4f("view", view);
 		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, env_cubemap);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, ibl_maps.env_cubemap);
 		renderer.DrawCube();
 
 		// Render GUI here
 		gui.Render(on_change);
+		stream_buffer.EndFrame();
 
 		/* Swap front and back buffers */
 		glfwSwapBuffers(window);
@@ -345,12 +626,7 @@ int main(void)
 	// Destroy window & GUI
 	gui.Destroy();
 
-	glDeleteRenderbuffers(1, &capture_rbo);
-	glDeleteFramebuffers(1, &capture_fbo);
-
-	glDeleteTextures(1, &env_cubemap);
-	glDeleteTextures(1, &irradiance_map);
-	glDeleteTextures(1, &prefilter_map);
+	Ibl::DeleteMaps(ibl_maps);
 	glDeleteTextures(1, &brdf_lut_texture);
 
 	glfwDestroyWindow(window);
@@ -376,13 +652,18 @@ void FrameBufferResizeCallback(GLFWwindow* window, int width, int height) {
 
 void MouseCallback(GLFWwindow* window, double xposIn, double yposIn)
 {
+	float xpos = static_cast<float>(xposIn);
+	float ypos = static_cast<float>(yposIn);
+
+	// The camera doesn't turn while picking, but keeps tracking the cursor so it doesn't jump once Z is released
 	if (glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS) {
+		pick_cursor = glm::vec2(xpos, ypos);
+		pick_requested = true;
+		lastX = xpos;
+		lastY = ypos;
 		return;
 	}
 
-	float xpos = static_cast<float>(xposIn);
-	float ypos = static_cast<float>(yposIn);
-
 	if (firstMouse)
 	{
 		lastX = xpos;
@@ -0,0 +1,224 @@
+#include "BufferArena.h"
+
+#include <algorithm>
+#include <cassert>
+#include <sstream>
+
+BufferArena::BufferArena(const std::initializer_list<VertexAttrib>& layout, unsigned int vertex_capacity, unsigned int index_capacity)
+	: layout_(layout), vertices_(vertex_capacity), indices_(index_capacity)
+{
+	for (const VertexAttrib& attrib : layout_) {
+		vertex_stride_ += attrib.count * Layout::GetTypeSize(attrib.type);
+	}
+}
+
+BufferArena::~BufferArena()
+{
+	if (vao_ != 0) {
+		glDeleteVertexArrays(1, &vao_);
+		glDeleteBuffers(1, &vertex_buffer_);
+		glDeleteBuffers(1, &index_buffer_);
+	}
+}
+
+void BufferArena::Create()
+{
+	glGenVertexArrays(1, &vao_);
+	glBindVertexArray(vao_);
+
+	// The format is separate from the buffer so a rebuild only has to swap the buffers
+	unsigned int offset = 0;
+	for (unsigned int i = 0; i < layout_.size(); ++i) {
+		glEnableVertexAttribArray(i);
+		glVertexAttribFormat(i, layout_[i].count, layout_[i].type, GL_FALSE, offset);
+		glVertexAttribBinding(i, 0);
+		offset += layout_[i].count * Layout::GetTypeSize(layout_[i].type);
+	}
+	glBindVertexArray(0);
+
+	Rebuild(vertices_.Capacity(), indices_.Capacity());
+}
+
+BufferArena::Handle BufferArena::Allocate(const void* vertices, unsigned int vertex_count, const unsigned int* indices, unsigned int index_count)
+{
+	assert(vertex_count > 0 && index_count > 0);
+	if (vao_ == 0) {
+		Create();
+	}
+
+	size_t vertex_offset = vertices_.Allocate(vertex_count);
+	size_t index_offset = indices_.Allocate(index_count);
+	if (vertex_offset == RangeAllocator::kInvalid || index_offset == RangeAllocator::kInvalid) {
+		if (vertex_offset != RangeAllocator::kInvalid) {
+			vertices_.Free(vertex_offset, vertex_count);
+		}
+		if (index_offset != RangeAllocator::kInvalid) {
+			indices_.Free(index_offset, index_count);
+		}
+
+		// Compacting is enough if the free space is only fragmented, otherwise grow by at least half
+		size_t vertex_capacity = vertices_.Capacity();
+		if (vertices_.FreeSize() < vertex_count) {
+			vertex_capacity = std::max(vertex_capacity + vertex_capacity / 2, vertex_capacity - vertices_.FreeSize() + vertex_count);
+		}
+		size_t index_capacity = indices_.Capacity();
+		if (indices_.FreeSize() < index_count) {
+			index_capacity = std::max(index_capacity + index_capacity / 2, index_capacity - indices_.FreeSize() + index_count);
+		}
+		Rebuild(vertex_capacity, index_capacity);
+
+		vertex_offset = vertices_.Allocate(vertex_count);
+		index_offset = indices_.Allocate(index_count);
+		assert(vertex_offset != RangeAllocator::kInvalid && index_offset != RangeAllocator::kInvalid);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+	glBufferSubData(GL_ARRAY_BUFFER, vertex_offset * vertex_stride_, static_cast<GLsizeiptr>(vertex_count) * vertex_stride_, vertices);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	// Not through GL_ELEMENT_ARRAY_BUFFER, that would change the binding of whatever VAO is bound
+	glBindBuffer(GL_COPY_WRITE_BUFFER, index_buffer_);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, index_offset * sizeof(unsigned int), static_cast<GLsizeiptr>(index_count) * sizeof(unsigned int), indices);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	Handle handle;
+	if (!free_handles_.empty()) {
+		handle = free_handles_.back();
+		free_handles_.pop_back();
+	}
+	else {
+		handle = static_cast<Handle>(allocations_.size());
+		allocations_.emplace_back();
+	}
+	Allocation& allocation = allocations_[handle];
+	allocation.vertex_offset = vertex_offset;
+	allocation.vertex_count = vertex_count;
+	allocation.index_offset = index_offset;
+	allocation.index_count = index_count;
+	allocation.live = true;
+	return handle;
+}
+
+void BufferArena::Free(Handle handle)
+{
+	Allocation& allocation = allocations_[handle];
+	assert(allocation.live);
+	vertices_.Free(allocation.vertex_offset, allocation.vertex_count);
+	indices_.Free(allocation.index_offset, allocation.index_count);
+	allocation.live = false;
+	free_handles_.push_back(handle);
+}
+
+BufferArena::Range BufferArena::Get(Handle handle) const
+{
+	const Allocation& allocation = allocations_[handle];
+	Range range;
+	range.base_vertex = static_cast<int>(allocation.vertex_offset);
+	range.first_index = static_cast<unsigned int>(allocation.index_offset);
+	range.index_count = static_cast<unsigned int>(allocation.index_count);
+	return range;
+}
+
+void BufferArena::Bind() const
+{
+	glBindVertexArray(vao_);
+}
+
+void BufferArena::Unbind() const
+{
+	glBindVertexArray(0);
+}
+
+void BufferArena::Draw(Handle handle) const
+{
+	const Allocation& allocation = allocations_[handle];
+	Draw(handle, 0, static_cast<unsigned int>(allocation.index_count), 0);
+}
+
+void BufferArena::Draw(Handle handle, unsigned int first_index, unsigned int index_count, int base_vertex) const
+{
+	const Allocation& allocation = allocations_[handle];
+	glDrawElementsBaseVertex(GL_TRIANGLES, index_count, GL_UNSIGNED_INT,
+		reinterpret_cast<void*>((allocation.index_offset + first_index) * sizeof(unsigned int)),
+		static_cast<int>(allocation.vertex_offset) + base_vertex);
+}
+
+void BufferArena::Defragment()
+{
+	if (vao_ != 0) {
+		Rebuild(vertices_.Capacity(), indices_.Capacity());
+	}
+}
+
+void BufferArena::Rebuild(size_t vertex_capacity, size_t index_capacity)
+{
+	unsigned int buffers[2];
+	glGenBuffers(2, buffers);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[0]);
+	glBufferData(GL_COPY_WRITE_BUFFER, vertex_capacity * vertex_stride_, nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[1]);
+	glBufferData(GL_COPY_WRITE_BUFFER, index_capacity * sizeof(unsigned int), nullptr, GL_STATIC_DRAW);
+
+	// Live ranges in their current order, packed to the front. GL doesn't copy between overlapping ranges of
+	// one buffer, so they always go to the new storage.
+	std::vector<Allocation*> live;
+	for (Allocation& allocation : allocations_) {
+		if (allocation.live) {
+			live.push_back(&allocation);
+		}
+	}
+
+	size_t vertex_end = 0;
+	glBindBuffer(GL_COPY_READ_BUFFER, vertex_buffer_);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[0]);
+	std::sort(live.begin(), live.end(), [](const Allocation* a, const Allocation* b) { return a->vertex_offset < b->vertex_offset; });
+	for (Allocation* allocation : live) {
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation->vertex_offset * vertex_stride_,
+			vertex_end * vertex_stride_, allocation->vertex_count * vertex_stride_);
+		allocation->vertex_offset = vertex_end;
+		vertex_end += allocation->vertex_count;
+	}
+
+	size_t index_end = 0;
+	glBindBuffer(GL_COPY_READ_BUFFER, index_buffer_);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[1]);
+	std::sort(live.begin(), live.end(), [](const Allocation* a, const Allocation* b) { return a->index_offset < b->index_offset; });
+	for (Allocation* allocation : live) {
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation->index_offset * sizeof(unsigned int),
+			index_end * sizeof(unsigned int), allocation->index_count * sizeof(unsigned int));
+		allocation->index_offset = index_end;
+		index_end += allocation->index_count;
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	if (vertex_buffer_ != 0) {
+		glDeleteBuffers(1, &vertex_buffer_);
+		glDeleteBuffers(1, &index_buffer_);
+	}
+	vertex_buffer_ = buffers[0];
+	index_buffer_ = buffers[1];
+	vertices_.Reset(vertex_capacity, vertex_end);
+	indices_.Reset(index_capacity, index_end);
+	rebuild_count_++;
+
+	glBindVertexArray(vao_);
+	glBindVertexBuffer(0, vertex_buffer_, 0, vertex_stride_);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+	glBindVertexArray(0);
+}
+
+unsigned int BufferArena::VertexStride() const
+{
+	return vertex_stride_;
+}
+
+std::string BufferArena::Report() const
+{
+	std::ostringstream report;
+	size_t live = allocations_.size() - free_handles_.size();
+	report << "Meshes: " << live << " in 1 VAO, "
+		<< (vertices_.Capacity() - vertices_.FreeSize()) * vertex_stride_ / 1024 << " / " << vertices_.Capacity() * vertex_stride_ / 1024 << " KB vertices, "
+		<< (indices_.Capacity() - indices_.FreeSize()) * sizeof(unsigned int) / 1024 << " / " << indices_.Capacity() * sizeof(unsigned int) / 1024 << " KB indices, "
+		<< rebuild_count_ << " rebuilds";
+	return report.str();
+}
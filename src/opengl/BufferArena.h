@@ -0,0 +1,73 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include "Layout.h"
+#include "../core/RangeAllocator.h"
+
+// One vertex buffer and one index buffer that many meshes suballocate their ranges from, drawn through a
+// single VAO with base-vertex offsets. Indices stay relative to their mesh's first vertex, so ranges can
+// move without rewriting them.
+// Freed ranges go back to a free-list. When an allocation doesn't fit, the buffers are compacted into new
+// storage (and grown if compacting alone isn't enough); allocation handles stay valid across that.
+// GL objects are created on the first allocation so the arena can live in objects created before the context.
+class BufferArena
+{
+public:
+	using Handle = unsigned int;
+
+	// Current place of an allocation in the shared buffers
+	struct Range {
+		int base_vertex = 0;
+		unsigned int first_index = 0;
+		unsigned int index_count = 0;
+	};
+
+	// `layout` describes one interleaved vertex like Layout::Push, capacities are in vertices and indices
+	BufferArena(const std::initializer_list<VertexAttrib>& layout, unsigned int vertex_capacity, unsigned int index_capacity);
+	~BufferArena();
+
+	Handle Allocate(const void* vertices, unsigned int vertex_count, const unsigned int* indices, unsigned int index_count);
+	void Free(Handle handle);
+	Range Get(Handle handle) const;
+
+	void Bind() const;
+	void Unbind() const;
+	// Triangles of the whole allocation or part of it, with `first_index` and `base_vertex` relative to the
+	// allocation. The arena has to be bound.
+	void Draw(Handle handle) const;
+	void Draw(Handle handle, unsigned int first_index, unsigned int index_count, int base_vertex) const;
+
+	// Moves all live ranges to the front of new buffers so the free space is one block again
+	void Defragment();
+
+	unsigned int VertexStride() const;
+	std::string Report() const;
+
+private:
+	struct Allocation {
+		size_t vertex_offset = 0;
+		size_t vertex_count = 0;
+		size_t index_offset = 0;
+		size_t index_count = 0;
+		bool live = false;
+	};
+
+	std::vector<VertexAttrib> layout_;
+	unsigned int vertex_stride_ = 0;
+	unsigned int vao_ = 0;
+	unsigned int vertex_buffer_ = 0;
+	unsigned int index_buffer_ = 0;
+	RangeAllocator vertices_;
+	RangeAllocator indices_;
+	std::vector<Allocation> allocations_;
+	std::vector<Handle> free_handles_;
+	unsigned int rebuild_count_ = 0;
+
+	void Create();
+	// Copies the live ranges compacted into new buffers of the given capacities
+	void Rebuild(size_t vertex_capacity, size_t index_capacity);
+};
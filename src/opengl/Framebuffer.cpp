@@ -12,8 +12,13 @@ Framebuffer::Framebuffer()
 Framebuffer::~Framebuffer()
 {
 	glDeleteFramebuffers(1, &id_);
-	glDeleteTextures(color_attachments_.size(), color_attachments_.data());
-	glDeleteTextures(1, &depth_attachment_);
+	glDeleteTextures(static_cast<GLsizei>(owned_textures_.size()), owned_textures_.data());
+	if (depth_is_texture_) {
+		glDeleteTextures(1, &depth_attachment_);
+	}
+	else {
+		glDeleteRenderbuffers(1, &depth_attachment_);
+	}
 }
 
 void Framebuffer::Bind()
@@ -35,20 +40,37 @@ void Framebuffer::AttachDepthBuffer(unsigned int width, unsigned int height)
 	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_attachment_);
 }
 
-void Framebuffer::AttachColorBuffer(unsigned int id, int internal_format, int format, unsigned int width, unsigned int height, int index)
+unsigned int Framebuffer::AttachDepthTexture(unsigned int width, unsigned int height)
 {
+	glGenTextures(1, &depth_attachment_);
+	glBindTexture(GL_TEXTURE_2D, depth_attachment_);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth_attachment_, 0);
+	depth_is_texture_ = true;
+	return depth_attachment_;
+}
+
+unsigned int Framebuffer::AttachColorBuffer(int internal_format, int format, int type, unsigned int width, unsigned int height)
+{
+	unsigned int id = 0;
 	glGenTextures(1, &id);
 	glBindTexture(GL_TEXTURE_2D, id);
 
-	// TODO - Make the data type changeable throught the parameter
-	glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+	glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, type, nullptr);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glBindTexture(GL_TEXTURE_2D, 0);
 
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + index_, GL_TEXTURE_2D, id, 0);
 	color_attachments_.push_back(id);
+	owned_textures_.push_back(id);
 	index_++;
+	UpdateDrawBuffers();
+	return id;
 }
 
 void Framebuffer::AttachColorBuffer(Texture2D& texture)
@@ -57,6 +79,27 @@ void Framebuffer::AttachColorBuffer(Texture2D& texture)
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + index_, GL_TEXTURE_2D, texture.ID(), 0);
 	color_attachments_.push_back(texture.ID());
 	index_++;
+	UpdateDrawBuffers();
+}
+
+unsigned int Framebuffer::ColorAttachment(unsigned int index) const
+{
+	return index < color_attachments_.size() ? color_attachments_[index] : 0;
+}
+
+unsigned int Framebuffer::DepthAttachment() const
+{
+	return depth_attachment_;
+}
+
+void Framebuffer::UpdateDrawBuffers()
+{
+	// Only the first attachment is drawn to by default
+	std::vector<GLenum> buffers(index_);
+	for (unsigned int i = 0; i < index_; ++i) {
+		buffers[i] = GL_COLOR_ATTACHMENT0 + i;
+	}
+	glDrawBuffers(static_cast<GLsizei>(buffers.size()), buffers.data());
 }
 
 void Framebuffer::Clear()
@@ -14,9 +14,15 @@ public:
 	void Unbind();
 
 	void AttachDepthBuffer(unsigned int width, unsigned int height);
-	void AttachColorBuffer(unsigned int id, int internal_format, int format, unsigned int width, unsigned int height, int index);
+	// A depth texture instead of a renderbuffer, for passes that read the depth back
+	unsigned int AttachDepthTexture(unsigned int width, unsigned int height);
+	// Creates a texture for the next color attachment and returns it, every attachment is drawn to
+	unsigned int AttachColorBuffer(int internal_format, int format, int type, unsigned int width, unsigned int height);
 	void AttachColorBuffer(Texture2D& texture);
 
+	unsigned int ColorAttachment(unsigned int index) const;
+	unsigned int DepthAttachment() const;
+
 	void Clear();
 	void Resize(unsigned int width, unsigned int height);
 
@@ -29,4 +35,9 @@ private:
 	unsigned int index_ = 0;
 	std::vector<unsigned int> color_attachments_;
 	unsigned int depth_attachment_ = 0;
+	bool depth_is_texture_ = false;
+	// Textures created by AttachColorBuffer, a Texture2D attachment belongs to its owner
+	std::vector<unsigned int> owned_textures_;
+
+	void UpdateDrawBuffers();
 };
@@ -0,0 +1,48 @@
+#include "GpuTimer.h"
+
+#include <glad/glad.h>
+
+GpuTimer::GpuTimer()
+{
+	glGenQueries(kQueryCount, queries_);
+}
+
+GpuTimer::~GpuTimer()
+{
+	glDeleteQueries(kQueryCount, queries_);
+}
+
+void GpuTimer::Begin()
+{
+	// Collect whatever finished since, oldest first
+	for (unsigned int i = 0; i < kQueryCount; ++i) {
+		unsigned int query = (next_ + i) % kQueryCount;
+		if (!pending_[query]) {
+			continue;
+		}
+		int available = 0;
+		glGetQueryObjectiv(queries_[query], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			continue;
+		}
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(queries_[query], GL_QUERY_RESULT, &nanoseconds);
+		milliseconds_ = nanoseconds / 1e6;
+		pending_[query] = false;
+	}
+
+	// A query still in flight after a full ring is dropped rather than waited for
+	glBeginQuery(GL_TIME_ELAPSED, queries_[next_]);
+}
+
+void GpuTimer::End()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	pending_[next_] = true;
+	next_ = (next_ + 1) % kQueryCount;
+}
+
+double GpuTimer::Milliseconds() const
+{
+	return milliseconds_;
+}
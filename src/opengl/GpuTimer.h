@@ -0,0 +1,27 @@
+#pragma once
+
+// GPU time of a span of commands from GL_TIME_ELAPSED queries. Results are read a few frames late from a
+// ring of queries so reading them never waits for the GPU.
+class GpuTimer
+{
+public:
+	GpuTimer();
+	~GpuTimer();
+
+	GpuTimer(const GpuTimer&) = delete;
+	GpuTimer& operator=(const GpuTimer&) = delete;
+
+	void Begin();
+	void End();
+
+	// Latest available result, 0 until the first one arrives
+	double Milliseconds() const;
+
+private:
+	static const unsigned int kQueryCount = 4;
+
+	unsigned int queries_[kQueryCount] = {};
+	bool pending_[kQueryCount] = {};
+	unsigned int next_ = 0;
+	double milliseconds_ = 0.0;
+};
@@ -23,9 +23,10 @@ public:
 
 	unsigned int Index() const;
 	unsigned int Stride() const;
+
+	static unsigned int GetTypeSize(int type);
 private:
 	unsigned int index_;
 	unsigned int stride_;
 	unsigned int offset_count_;
-	unsigned int GetTypeSize(int type);
 };
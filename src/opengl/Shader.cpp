@@ -1,45 +1,219 @@
 #include "Shader.h"
 
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <sstream>
+
+#include "../core/ProgramCache.h"
+
+// GL_KHR_parallel_shader_compile (and the identical ARB version) aren't in the generated loader
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+bool Shader::parallel_compile_ = false;
+
+namespace {
+	// Deep enough for any sane include chain, shallow enough to stop a cycle that slips past the once-guard
+	const int kMaxIncludeDepth = 16;
+
+	double MillisecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	size_t ValueSize(int kind)
+	{
+		// Matches Shader::UniformKind
+		const size_t sizes[] = { sizeof(int), sizeof(float), 2 * sizeof(float), 3 * sizeof(float), 4 * sizeof(float), 9 * sizeof(float), 16 * sizeof(float) };
+		return sizes[kind];
+	}
+
+	std::string NormalPath(const std::string& path)
+	{
+		return std::filesystem::path(path).lexically_normal().generic_string();
+	}
+}
 
 Shader::Shader()
 {
 }
 
-Shader::Shader(const std::string& vertex_path, const std::string& fragment_path)
+Shader::Shader(const std::string& vertex_path, const std::string& fragment_path, const std::vector<std::string>& defines)
 {
-	std::string vertex_source = ParseShader(vertex_path);
-	std::string fragment_source = ParseShader(fragment_path);
+	stage_paths_ = { { GL_VERTEX_SHADER, vertex_path }, { GL_FRAGMENT_SHADER, fragment_path } };
+	defines_ = defines;
+	name_ = vertex_path.substr(vertex_path.find_last_of("/\\") + 1) + "+" + fragment_path.substr(fragment_path.find_last_of("/\\") + 1);
+	// Tells the variants of one pair apart in the log
+	for (const std::string& define : defines) {
+		name_ += " " + define;
+	}
+	Build({
+		{ GL_VERTEX_SHADER, InjectDefines(ParseShader(vertex_path), defines) },
+		{ GL_FRAGMENT_SHADER, InjectDefines(ParseShader(fragment_path), defines) },
+	});
+}
 
-	const char* vertex_source_pointer = vertex_source.c_str();
-	const char* fragment_source_pointer = fragment_source.c_str();
+Shader::Shader(const std::string& compute_path)
+{
+	stage_paths_ = { { GL_COMPUTE_SHADER, compute_path } };
+	name_ = compute_path.substr(compute_path.find_last_of("/\\") + 1);
+	Build({ { GL_COMPUTE_SHADER, ParseShader(compute_path) } });
+}
 
-	unsigned int vertex_shader;
-	vertex_shader = CompileShader(vertex_source_pointer, GL_VERTEX_SHADER);
+bool Shader::EnableParallelCompile(GLADloadproc load)
+{
+	const char* function = nullptr;
+	int count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (int i = 0; i < count && !function; ++i) {
+		const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+		if (std::strcmp(extension, "GL_KHR_parallel_shader_compile") == 0) {
+			function = "glMaxShaderCompilerThreadsKHR";
+		}
+		else if (std::strcmp(extension, "GL_ARB_parallel_shader_compile") == 0) {
+			function = "glMaxShaderCompilerThreadsARB";
+		}
+	}
+	if (!function) {
+		return false;
+	}
 
-	unsigned int fragment_shader;
-	fragment_shader = CompileShader(fragment_source_pointer, GL_FRAGMENT_SHADER);
+	// All the threads the driver wants, the default may be as low as one
+	auto max_shader_compiler_threads = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(load(function));
+	if (max_shader_compiler_threads) {
+		max_shader_compiler_threads(0xFFFFFFFFu);
+	}
+	parallel_compile_ = true;
+	return true;
+}
+
+void Shader::Build(const std::vector<Stage>& stages)
+{
+	submitted_ = std::chrono::steady_clock::now();
+	std::vector<std::string> sources;
+	for (const Stage& stage : stages) {
+		sources.push_back(stage.source);
+	}
+	key_ = ProgramCache::ComputeKey(sources);
+
+	for (const std::string& dependency : dependencies_) {
+		std::error_code error;
+		dependency_times_.push_back(std::filesystem::last_write_time(dependency, error));
+	}
 
 	id_ = glCreateProgram();
-	glAttachShader(id_, vertex_shader);
-	glAttachShader(id_, fragment_shader);
+	if (LoadBinary(key_)) {
+		linked_ = true;
+		Reflect();
+		std::cout << "SHADER::READY " << name_ << " " << MillisecondsSince(submitted_) << " ms (binary cache)" << std::endl;
+		return;
+	}
+
+	// Only submitted here, nothing queries a status until Finish so the driver can compile in the background
+	for (const Stage& stage : stages) {
+		PendingStage pending;
+		pending.type = stage.type;
+		pending.shader = CompileShader(stage.source.c_str(), stage.type);
+		glAttachShader(id_, pending.shader);
+		pending_stages_.push_back(pending);
+	}
+	glProgramParameteri(id_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(id_);
+	pending_ = true;
+}
+
+bool Shader::Ready() const
+{
+	if (!pending_ || !parallel_compile_) {
+		return true;
+	}
+
+	int completed = GL_FALSE;
+	glGetProgramiv(id_, GL_COMPLETION_STATUS_KHR, &completed);
+	return completed == GL_TRUE;
+}
+
+void Shader::Finish()
+{
+	if (!pending_) {
+		return;
+	}
+	pending_ = false;
+
+	// Blocks if the driver is still busy, without the extension this is where the whole compile happens
+	auto wait_start = std::chrono::steady_clock::now();
+	for (const PendingStage& stage : pending_stages_) {
+		CheckCompileStatus(stage.shader, stage.type);
+	}
 
 	// Check for shader program linking errors
 	int program_linked;
 	glGetProgramiv(id_, GL_LINK_STATUS, &program_linked);
+	double waited = MillisecondsSince(wait_start);
 	if (program_linked != GL_TRUE)
 	{
 		int log_length = 0;
 		char message[1024];
 		glGetProgramInfoLog(id_, 1024, &log_length, message);
-		std::cout << "ERROR::OPENGL::SHADER::PROGRAM_LINK_FAILED" << std::endl;
+		std::cout << "ERROR::OPENGL::SHADER::PROGRAM_LINK_FAILED " << name_ << "\n" << message << std::endl;
+	}
+	else {
+		linked_ = true;
+		StoreBinary(key_);
 	}
 
-	glDeleteShader(vertex_shader);
-	glDeleteShader(fragment_shader);
+	for (const PendingStage& stage : pending_stages_) {
+		glDeleteShader(stage.shader);
+	}
+	pending_stages_.clear();
+	Reflect();
+	std::cout << "SHADER::READY " << name_ << " " << MillisecondsSince(submitted_) << " ms (compiled, " << waited << " ms blocked)" << std::endl;
+}
+
+bool Shader::LoadBinary(uint64_t key)
+{
+	int format_count = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+	unsigned int format = 0;
+	std::vector<unsigned char> binary;
+	if (format_count == 0 || !ProgramCache::Load(key, format, binary)) {
+		return false;
+	}
+
+	glProgramBinary(id_, format, binary.data(), static_cast<GLsizei>(binary.size()));
+	int program_linked;
+	glGetProgramiv(id_, GL_LINK_STATUS, &program_linked);
+	if (program_linked == GL_TRUE) {
+		return true;
+	}
+
+	// The driver may refuse its own binaries, e.g. after a change it doesn't reflect in the version string
+	std::cout << "WARNING::OPENGL::SHADER::PROGRAM_BINARY_REJECTED " << ProgramCache::PathForKey(key) << std::endl;
+	glDeleteProgram(id_);
+	id_ = glCreateProgram();
+	return false;
+}
+
+void Shader::StoreBinary(uint64_t key)
+{
+	int length = 0;
+	glGetProgramiv(id_, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length == 0) {
+		return;
+	}
+
+	std::vector<unsigned char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(id_, length, &length, &format, binary.data());
+	binary.resize(length);
+	ProgramCache::Store(key, format, binary);
 }
 
 void Shader::Bind() const
@@ -58,59 +232,174 @@ unsigned int Shader::GetId() const
 	return id_;
 }
 
-void Shader::SetBool(const std::string& name, bool value)
+void Shader::SetBool(Uniform name, bool value)
 {
-	glUniform1i(GetUniformLocation(name), (int)value);
+	int integer = value ? 1 : 0;
+	Store(name, UniformKind::Int, &integer, 1);
 }
 
-void Shader::SetInt(const std::string& name, int value)
+void Shader::SetInt(Uniform name, int value)
 {
-	glUniform1i(GetUniformLocation(name), value);
+	Store(name, UniformKind::Int, &value, 1);
 }
 
-void Shader::SetFloat(const std::string& name, float value)
+void Shader::SetFloat(Uniform name, float value)
 {
-	glUniform1f(GetUniformLocation(name), value);
+	Store(name, UniformKind::Float, &value, 1);
 }
 
-void Shader::SetVec2f(const std::string& name, const glm::vec2& vector)
+void Shader::SetVec2f(Uniform name, const glm::vec2& vector)
 {
-	glUniform2fv(GetUniformLocation(name), 1, &vector[0]);
+	Store(name, UniformKind::Vec2, &vector[0], 1);
 }
 
-void Shader::SetVec2f(const std::string& name, float x, float y)
+void Shader::SetVec2f(Uniform name, float x, float y)
 {
-	glUniform2f(GetUniformLocation(name), x, y);
+	SetVec2f(name, glm::vec2(x, y));
 }
 
-void Shader::SetVec3f(const std::string& name, const glm::vec3& vector)
+void Shader::SetVec3f(Uniform name, const glm::vec3& vector)
 {
-	glUniform3fv(GetUniformLocation(name), 1, &vector[0]);
+	Store(name, UniformKind::Vec3, &vector[0], 1);
 }
 
-void Shader::SetVec3f(const std::string& name, float x, float y, float z)
+void Shader::SetVec3f(Uniform name, float x, float y, float z)
 {
-	glUniform3f(GetUniformLocation(name), x, y, z);
+	SetVec3f(name, glm::vec3(x, y, z));
 }
 
-void Shader::SetVec4f(const std::string& name, const glm::vec4& vector)
+void Shader::SetVec3fArray(Uniform name, const glm::vec3* vectors, int count)
 {
-	glUniform4fv(GetUniformLocation(name), 1, &vector[0]);
+	Store(name, UniformKind::Vec3, &vectors[0][0], count);
 }
 
-void Shader::SetVec4f(const std::string& name, float x, float y, float z, float w)
+void Shader::SetVec4f(Uniform name, const glm::vec4& vector)
 {
-	glUniform4f(GetUniformLocation(name), x, y, z, w);
+	Store(name, UniformKind::Vec4, &vector[0], 1);
 }
 
-void Shader::SetMat3f(const std::string& name, const glm::mat3& matrix)
+void Shader::SetVec4f(Uniform name, float x, float y, float z, float w)
 {
-	glUniformMatrix3fv(GetUniformLocation(name), 1, GL_FALSE, &matrix[0][0]);
+	SetVec4f(name, glm::vec4(x, y, z, w));
 }
 
-void Shader::SetMat4f(const std::string& name, const glm::mat4& matrix)
+void Shader::SetMat3f(Uniform name, const glm::mat3& matrix)
 {
-	glUniformMatrix4fv(GetUniformLocation(name), 1, GL_FALSE, &matrix[0][0]);
+	Store(name, UniformKind::Mat3, &matrix[0][0], 1);
+}
+
+void Shader::SetMat4f(Uniform name, const glm::mat4& matrix)
+{
+	Store(name, UniformKind::Mat4, &matrix[0][0], 1);
+}
+
+void Shader::Store(Uniform name, UniformKind kind, const void* data, int count)
+{
+	UniformSlot* slot = FindSlot(name.hash);
+	if (!slot) {
+		return;
+	}
+
+	// Kept so a hot-reloaded program starts with the same values, the storage is reused after the first set
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	slot->kind = kind;
+	slot->count = count;
+	slot->value.assign(bytes, bytes + ValueSize(static_cast<int>(kind)) * count);
+	Apply(*slot);
+}
+
+void Shader::Apply(const UniformSlot& slot) const
+{
+	const float* floats = reinterpret_cast<const float*>(slot.value.data());
+	switch (slot.kind) {
+	case UniformKind::Int:
+		glProgramUniform1iv(id_, slot.location, slot.count, reinterpret_cast<const int*>(slot.value.data()));
+		break;
+	case UniformKind::Float:
+		glProgramUniform1fv(id_, slot.location, slot.count, floats);
+		break;
+	case UniformKind::Vec2:
+		glProgramUniform2fv(id_, slot.location, slot.count, floats);
+		break;
+	case UniformKind::Vec3:
+		glProgramUniform3fv(id_, slot.location, slot.count, floats);
+		break;
+	case UniformKind::Vec4:
+		glProgramUniform4fv(id_, slot.location, slot.count, floats);
+		break;
+	case UniformKind::Mat3:
+		glProgramUniformMatrix3fv(id_, slot.location, slot.count, GL_FALSE, floats);
+		break;
+	case UniformKind::Mat4:
+		glProgramUniformMatrix4fv(id_, slot.location, slot.count, GL_FALSE, floats);
+		break;
+	}
+}
+
+const std::string& Shader::GetName() const
+{
+	return name_;
+}
+
+bool Shader::SourcesChanged() const
+{
+	if (rebuild_) {
+		return false;
+	}
+	for (size_t i = 0; i < dependencies_.size(); ++i) {
+		std::error_code error;
+		if (std::filesystem::last_write_time(dependencies_[i], error) != dependency_times_[i]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void Shader::Reload()
+{
+	if (stage_paths_.size() == 1) {
+		rebuild_ = std::make_unique<Shader>(stage_paths_[0].second);
+	}
+	else {
+		rebuild_ = std::make_unique<Shader>(stage_paths_[0].second, stage_paths_[1].second, defines_);
+	}
+}
+
+bool Shader::UpdateReload()
+{
+	if (!rebuild_ || !rebuild_->Ready()) {
+		return false;
+	}
+
+	rebuild_->Finish();
+	// The new file set is watched either way, so fixing a broken include retriggers the rebuild
+	dependencies_ = rebuild_->dependencies_;
+	dependency_times_ = rebuild_->dependency_times_;
+	if (!rebuild_->linked_) {
+		std::cout << "WARNING::OPENGL::SHADER::RELOAD_FAILED " << name_ << " keeps the previous program" << std::endl;
+		rebuild_.reset();
+		return false;
+	}
+
+	for (const UniformSlot& slot : uniforms_) {
+		if (slot.value.empty()) {
+			continue;
+		}
+		UniformSlot* target = rebuild_->FindSlot(slot.hash);
+		if (target) {
+			target->kind = slot.kind;
+			target->count = slot.count;
+			target->value = slot.value;
+			rebuild_->Apply(*target);
+		}
+	}
+
+	// The old program goes with the rebuild, GL keeps it alive until draws using it are done
+	std::swap(id_, rebuild_->id_);
+	std::swap(uniforms_, rebuild_->uniforms_);
+	std::swap(key_, rebuild_->key_);
+	rebuild_.reset();
+	return true;
 }
 
 void Shader::PreloadShader(const std::string& path)
@@ -120,16 +409,95 @@ void Shader::PreloadShader(const std::string& path)
 
 std::string Shader::ParseShader(const std::string& path)
 {
-	std::ifstream file(path);
+	std::vector<std::string> included;
+	return Preprocess(NormalPath(path), included, 0);
+}
+
+std::string Shader::Preprocess(const std::string& path, std::vector<std::string>& included, int depth)
+{
+	if (depth > kMaxIncludeDepth) {
+		std::cout << "ERROR::OPENGL::SHADER::INCLUDE_TOO_DEEP " << path << std::endl;
+		return "";
+	}
+	included.push_back(path);
+
+	// Files are numbered in the order they are first seen, the #line directives below use that number
+	auto known = std::find(dependencies_.begin(), dependencies_.end(), path);
+	size_t file_number = known - dependencies_.begin();
+	if (known == dependencies_.end()) {
+		dependencies_.push_back(path);
+	}
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		std::cout << "ERROR::OPENGL::SHADER::FILE_NOT_FOUND " << path << std::endl;
+		return "";
+	}
+	std::stringstream content;
+	content << file.rdbuf();
+
+	std::string directory = path.substr(0, path.find_last_of('/') + 1);
+	std::string output;
+	if (depth > 0) {
+		output.append("#line 1 " + std::to_string(file_number) + "\n");
+	}
+
 	std::string line;
-	std::string content;
-	while (getline(file, line)) {
-		content.append(line + "\n");
+	int line_number = 0;
+	while (std::getline(content, line)) {
+		++line_number;
+		size_t start = line.find_first_not_of(" \t");
+		if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+			output.append(line).append("\n");
+			continue;
+		}
+
+		// #include "file" or <file>, relative to the including file. Every file is pasted once per stage.
+		size_t open = line.find_first_of("\"<", start + 8);
+		size_t close = open == std::string::npos ? std::string::npos : line.find_first_of("\">", open + 1);
+		if (close == std::string::npos) {
+			std::cout << "ERROR::OPENGL::SHADER::MALFORMED_INCLUDE " << path << ":" << line_number << std::endl;
+			continue;
+		}
+		std::string include_path = NormalPath(directory + line.substr(open + 1, close - open - 1));
+		if (std::find(included.begin(), included.end(), include_path) == included.end()) {
+			output.append(Preprocess(include_path, included, depth + 1));
+			output.append("#line " + std::to_string(line_number + 1) + " " + std::to_string(file_number) + "\n");
+		}
 	}
-	return content;
+	return output;
+}
+
+std::string Shader::InjectDefines(const std::string& source, const std::vector<std::string>& defines)
+{
+	if (defines.empty()) {
+		return source;
+	}
+
+	std::string define_lines;
+	for (const std::string& define : defines) {
+		define_lines.append("#define " + define + "\n");
+	}
+
+	// #version has to stay the first directive
+	size_t version = source.find("#version");
+	size_t insert_at = version == std::string::npos ? 0 : source.find('\n', version) + 1;
+	// Keeps compile errors pointing at the lines in the file
+	size_t next_line = std::count(source.begin(), source.begin() + insert_at, '\n') + 1;
+	define_lines.append("#line " + std::to_string(next_line) + " 0\n");
+	return source.substr(0, insert_at) + define_lines + source.substr(insert_at);
 }
 
 unsigned int Shader::CompileShader(const char* source, GLuint type)
+{
+	unsigned int shader;
+	shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, nullptr);
+	glCompileShader(shader);
+	return shader;
+}
+
+void Shader::CheckCompileStatus(unsigned int shader, GLuint type)
 {
 	int success;
 	char infoLog[512];
@@ -140,11 +508,9 @@ unsigned int Shader::CompileShader(const char* source, GLuint type)
 	else if (type == GL_FRAGMENT_SHADER) {
 		shaderType = "FRAGMENT";
 	}
-
-	unsigned int shader;
-	shader = glCreateShader(type);
-	glShaderSource(shader, 1, &source, nullptr);
-	glCompileShader(shader);
+	else if (type == GL_COMPUTE_SHADER) {
+		shaderType = "COMPUTE";
+	}
 
 	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
 	if (!success)
@@ -152,25 +518,67 @@ unsigned int Shader::CompileShader(const char* source, GLuint type)
 		glGetShaderInfoLog(shader, 512, NULL, infoLog);
 		std::cout << "ERROR::OPENGL::SHADER::" << shaderType << "::COMPILATION_FAILED\n" << infoLog << std::endl;
 	};
-
-	return shader;
 }
 
-int Shader::GetUniformLocation(const std::string& name)
+void Shader::Reflect()
 {
-	int uniform_loc;
-	if (uniform_cache_.find(name) != uniform_cache_.end()) {
-		uniform_loc = uniform_cache_[name];
+	int count = 0;
+	glGetProgramInterfaceiv(id_, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+
+	const GLenum properties[] = { GL_NAME_LENGTH, GL_LOCATION, GL_BLOCK_INDEX };
+	std::string name;
+	for (int i = 0; i < count; ++i) {
+		int values[3];
+		glGetProgramResourceiv(id_, GL_UNIFORM, i, 3, properties, 3, nullptr, values);
+		// Members of uniform blocks have no location, they are written through buffers
+		if (values[2] != -1 || values[1] == -1) {
+			continue;
+		}
+
+		name.resize(values[0]);
+		glGetProgramResourceName(id_, GL_UNIFORM, i, values[0], nullptr, &name[0]);
+		name.resize(values[0] - 1);
+		// Arrays are reported as "name[0]" and set through their first element
+		if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+			name.resize(name.size() - 3);
+		}
+
+		UniformSlot slot;
+		slot.hash = Uniform(name).hash;
+		slot.location = values[1];
+		uniforms_.push_back(slot);
 	}
-	else {
-		uniform_loc = glGetUniformLocation(id_, name.c_str());
-		uniform_cache_[name] = uniform_loc;
+
+	std::sort(uniforms_.begin(), uniforms_.end(), [](const UniformSlot& a, const UniformSlot& b) { return a.hash < b.hash; });
+	for (size_t i = 1; i < uniforms_.size(); ++i) {
+		if (uniforms_[i].hash == uniforms_[i - 1].hash) {
+			std::cout << "ERROR::OPENGL::SHADER::UNIFORM_HASH_COLLISION" << std::endl;
+		}
 	}
+}
+
+int Shader::GetUniformLocation(Uniform name)
+{
+	UniformSlot* slot = FindSlot(name.hash);
+	return slot ? slot->location : -1;
+}
 
-	return uniform_loc;
+Shader::UniformSlot* Shader::FindSlot(uint32_t hash)
+{
+	// Reflection only happens once the program is linked
+	Finish();
+	auto slot = std::lower_bound(uniforms_.begin(), uniforms_.end(), hash,
+		[](const UniformSlot& slot, uint32_t hash) { return slot.hash < hash; });
+	if (slot == uniforms_.end() || slot->hash != hash) {
+		return nullptr;
+	}
+	return &*slot;
 }
 
 Shader::~Shader()
 {
+	for (const PendingStage& stage : pending_stages_) {
+		glDeleteShader(stage.shader);
+	}
 	glDeleteProgram(id_);
 }
\ No newline at end of file
@@ -1,38 +1,120 @@
 #pragma once
 
+#include <chrono>
 #include <string>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
-#include <unordered_map>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include "../core/Hash.h"
 
 class Shader
 {
 public:
+	// A uniform name as its FNV-1a hash. Literals are hashed at compile time (guaranteed for
+	// `constexpr Shader::Uniform` constants), so setters neither allocate nor hash strings at runtime.
+	struct Uniform {
+		uint32_t hash;
+		constexpr Uniform(const char* name) : hash(Hash::Fnv1a32(name)) {}
+		Uniform(const std::string& name) : hash(Hash::Fnv1a32(name.c_str())) {}
+	};
+
 	Shader();
-	Shader(const std::string& vertexPath, const std::string& fragmentPath);
+	// `defines` are inserted as #define lines after the #version directive of both stages to select a variant
+	Shader(const std::string& vertexPath, const std::string& fragmentPath, const std::vector<std::string>& defines = {});
+	explicit Shader(const std::string& computePath);
 	~Shader();
+
+	// Lets the driver compile on its own threads (KHR/ARB_parallel_shader_compile) if it can. Call once after
+	// loading GL, before creating shaders. Without it, Finish does the whole compile.
+	static bool EnableParallelCompile(GLADloadproc load);
+	// The constructors only submit the compile and link. Ready polls without blocking, Finish waits, reports
+	// errors and the compile time, and fills the binary cache. Uniform setters finish implicitly.
+	bool Ready() const;
+	void Finish();
+
+	// Hot reload. SourcesChanged compares the modification times of every file the program was preprocessed
+	// from. Reload submits a rebuild in the background, UpdateReload swaps it in once the driver is done, with
+	// the uniform values carried over, and returns true then. A rebuild that fails to compile keeps the old program.
+	bool SourcesChanged() const;
+	void Reload();
+	bool UpdateReload();
+	const std::string& GetName() const;
+
 	void Bind() const;
 	void Unbind();
 
 	unsigned int GetId() const;
 
-	void SetBool(const std::string& name, bool value);
-	void SetInt(const std::string& name, int value);
-	void SetFloat(const std::string& name, float value);
-	void SetVec2f(const std::string& name, const glm::vec2& vector);
-	void SetVec2f(const std::string& name, float x, float y);
-	void SetVec3f(const std::string& name, const glm::vec3& vector);
-	void SetVec3f(const std::string& name, float x, float y, float z);
-	void SetVec4f(const std::string& name, const glm::vec4& vector);
-	void SetVec4f(const std::string& name, float x, float y, float z, float w);
-	void SetMat3f(const std::string& name, const glm::mat3& matrix);
-	void SetMat4f(const std::string& name, const glm::mat4& matrix);
+	void SetBool(Uniform name, bool value);
+	void SetInt(Uniform name, int value);
+	void SetFloat(Uniform name, float value);
+	void SetVec2f(Uniform name, const glm::vec2& vector);
+	void SetVec2f(Uniform name, float x, float y);
+	void SetVec3f(Uniform name, const glm::vec3& vector);
+	void SetVec3f(Uniform name, float x, float y, float z);
+	void SetVec3fArray(Uniform name, const glm::vec3* vectors, int count);
+	void SetVec4f(Uniform name, const glm::vec4& vector);
+	void SetVec4f(Uniform name, float x, float y, float z, float w);
+	void SetMat3f(Uniform name, const glm::mat3& matrix);
+	void SetMat4f(Uniform name, const glm::mat4& matrix);
 	void PreloadShader(const std::string& path);
+
+	// Location of an active default-block uniform, -1 like glGetUniformLocation if there is none
+	int GetUniformLocation(Uniform name);
 private:
+	struct Stage {
+		GLenum type;
+		std::string source;
+	};
+	enum class UniformKind { Int, Float, Vec2, Vec3, Vec4, Mat3, Mat4 };
+
+	struct PendingStage {
+		GLenum type;
+		unsigned int shader;
+	};
+	struct UniformSlot {
+		uint32_t hash;
+		int location;
+		// Last value set, replayed into a reloaded program
+		UniformKind kind = UniformKind::Int;
+		int count = 0;
+		std::vector<unsigned char> value;
+	};
+
 	unsigned int id_;
-	std::unordered_map<std::string, int> uniform_cache_;
+	std::string name_;
+	uint64_t key_ = 0;
+	bool pending_ = false;
+	std::vector<PendingStage> pending_stages_;
+	std::chrono::steady_clock::time_point submitted_;
+	static bool parallel_compile_;
+	bool linked_ = false;
+
+	// What the program was built from, for hot reload
+	std::vector<std::pair<GLenum, std::string>> stage_paths_;
+	std::vector<std::string> defines_;
+	std::vector<std::string> dependencies_;
+	std::vector<std::filesystem::file_time_type> dependency_times_;
+	std::unique_ptr<Shader> rebuild_;
+	// Active uniforms found after linking, sorted by hash
+	std::vector<UniformSlot> uniforms_;
 
+	// Reads `path` with its #includes resolved, recording every file in dependencies_
 	std::string ParseShader(const std::string& path);
+	std::string Preprocess(const std::string& path, std::vector<std::string>& included, int depth);
+	static std::string InjectDefines(const std::string& source, const std::vector<std::string>& defines);
 	unsigned int CompileShader(const char* source, GLuint type);
-	int GetUniformLocation(const std::string& name);
+	void CheckCompileStatus(unsigned int shader, GLuint type);
+	// Submits the stages for compile and link, or loads the program from the binary cache when the sources and driver match
+	void Build(const std::vector<Stage>& stages);
+	bool LoadBinary(uint64_t key);
+	void StoreBinary(uint64_t key);
+	void Reflect();
+	UniformSlot* FindSlot(uint32_t hash);
+	void Store(Uniform name, UniformKind kind, const void* data, int count);
+	void Apply(const UniformSlot& slot) const;
 };
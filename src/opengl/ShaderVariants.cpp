@@ -0,0 +1,69 @@
+#include "ShaderVariants.h"
+
+#include <iostream>
+
+ShaderVariants::ShaderVariants(const std::string& vertex_path, const std::string& fragment_path, const std::vector<std::string>& defines,
+	const std::vector<std::string>& flag_names, const std::string& value_name)
+	: vertex_path_(vertex_path), fragment_path_(fragment_path), defines_(defines), flag_names_(flag_names), value_name_(value_name)
+{
+}
+
+void ShaderVariants::SetInitializer(const std::function<void(Shader&)>& initializer)
+{
+	initializer_ = initializer;
+}
+
+void ShaderVariants::Prepare(unsigned int key)
+{
+	Create(key);
+}
+
+Shader& ShaderVariants::Get(unsigned int key)
+{
+	Variant& variant = Create(key);
+	if (!variant.initialized) {
+		variant.initialized = true;
+		if (initializer_) {
+			initializer_(*variant.shader);
+		}
+	}
+	return *variant.shader;
+}
+
+void ShaderVariants::ForEach(const std::function<void(Shader&)>& function)
+{
+	for (auto& entry : variants_) {
+		if (entry.second.initialized) {
+			function(*entry.second.shader);
+		}
+	}
+}
+
+size_t ShaderVariants::Count() const
+{
+	return variants_.size();
+}
+
+ShaderVariants::Variant& ShaderVariants::Create(unsigned int key)
+{
+	Variant& variant = variants_[key];
+	if (variant.shader) {
+		return variant;
+	}
+
+	std::vector<std::string> defines = defines_;
+	for (unsigned int bit = 0; bit < flag_names_.size(); ++bit) {
+		if (key & (1u << bit)) {
+			defines.push_back(flag_names_[bit]);
+		}
+	}
+	if (!value_name_.empty()) {
+		defines.push_back(value_name_ + " " + std::to_string(key >> kValueShift));
+	}
+
+	if ((key & ((1u << kValueShift) - 1)) >> flag_names_.size() != 0) {
+		std::cout << "WARNING::SHADER_VARIANTS::UNKNOWN_FLAGS " << key << std::endl;
+	}
+	variant.shader = std::make_unique<Shader>(vertex_path_, fragment_path_, defines);
+	return variant;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Shader.h"
+
+// Permutations of one vertex/fragment pair selected by #define feature keys. A key's low bits each add one
+// flag define, the bits from kValueShift up are passed as a value define (e.g. SAMPLE_COUNT 16). Variants are
+// compiled on first use and kept; the binary cache makes them cheap on later runs.
+class ShaderVariants
+{
+public:
+	static const unsigned int kValueShift = 16;
+	static unsigned int Key(unsigned int flags, unsigned int value) { return flags | value << kValueShift; }
+
+	// `defines` are set in every variant, `flag_names` are the flag defines in bit order. Without a `value_name`
+	// the value bits are ignored.
+	ShaderVariants(const std::string& vertex_path, const std::string& fragment_path, const std::vector<std::string>& defines,
+		const std::vector<std::string>& flag_names, const std::string& value_name = "");
+
+	// Runs once per variant before Get first returns it, e.g. to set sampler units
+	void SetInitializer(const std::function<void(Shader&)>& initializer);
+	// Submits the compile of a variant that will be needed soon without waiting for it
+	void Prepare(unsigned int key);
+	Shader& Get(unsigned int key);
+	// Every variant Get has returned so far
+	void ForEach(const std::function<void(Shader&)>& function);
+	size_t Count() const;
+
+private:
+	struct Variant {
+		std::unique_ptr<Shader> shader;
+		bool initialized = false;
+	};
+
+	std::string vertex_path_;
+	std::string fragment_path_;
+	std::vector<std::string> defines_;
+	std::vector<std::string> flag_names_;
+	std::string value_name_;
+	std::function<void(Shader&)> initializer_;
+	std::map<unsigned int, Variant> variants_;
+
+	Variant& Create(unsigned int key);
+};
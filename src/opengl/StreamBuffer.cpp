@@ -0,0 +1,117 @@
+#include "StreamBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+	size_t AlignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+StreamBuffer::StreamBuffer(size_t frame_size, unsigned int frame_count)
+	: frame_size_(frame_size), frame_count_(frame_count), fences_(frame_count, nullptr)
+{
+	int uniform_alignment = 0, storage_alignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_alignment);
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storage_alignment);
+	alignment_ = std::max<size_t>({ 16, static_cast<size_t>(uniform_alignment), static_cast<size_t>(storage_alignment) });
+	Create(AlignUp(frame_size, alignment_));
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	for (GLsync fence : fences_) {
+		if (fence) {
+			glDeleteSync(fence);
+		}
+	}
+	if (!retired_.empty()) {
+		glDeleteBuffers(static_cast<GLsizei>(retired_.size()), retired_.data());
+	}
+	glDeleteBuffers(1, &id_);
+}
+
+void StreamBuffer::Create(size_t frame_size)
+{
+	frame_size_ = frame_size;
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &id_);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, id_);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, frame_size_ * frame_count_, nullptr, flags);
+	mapped_ = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, frame_size_ * frame_count_, flags));
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void StreamBuffer::BeginFrame()
+{
+	if (!retired_.empty()) {
+		glDeleteBuffers(static_cast<GLsizei>(retired_.size()), retired_.data());
+		retired_.clear();
+	}
+
+	frame_ = (frame_ + 1) % frame_count_;
+	head_ = 0;
+	GLsync& fence = fences_[frame_];
+	if (fence) {
+		// Normally signalled long ago, the frames in flight are what hides the latency
+		while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+		}
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+}
+
+void StreamBuffer::EndFrame()
+{
+	fences_[frame_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+size_t StreamBuffer::Write(const void* data, size_t size)
+{
+	if (head_ + size > frame_size_) {
+		Grow(size);
+	}
+
+	size_t offset = frame_ * frame_size_ + head_;
+	std::memcpy(mapped_ + offset, data, size);
+	head_ = AlignUp(head_ + size, alignment_);
+	return offset;
+}
+
+void StreamBuffer::Reserve(size_t size, unsigned int writes)
+{
+	size_t needed = size + writes * alignment_;
+	if (head_ + needed > frame_size_) {
+		Grow(needed);
+	}
+}
+
+void StreamBuffer::BindRange(GLenum target, unsigned int binding, size_t offset, size_t size) const
+{
+	glBindBufferRange(target, binding, id_, offset, size);
+}
+
+unsigned int StreamBuffer::Id() const
+{
+	return id_;
+}
+
+void StreamBuffer::Grow(size_t needed)
+{
+	size_t frame_size = AlignUp(std::max(frame_size_ * 2, frame_size_ + needed), alignment_);
+	std::cout << "WARNING::STREAM_BUFFER::FRAME_DOES_NOT_FIT growing to " << frame_size / 1024 << " KB per frame" << std::endl;
+
+	// Ranges written before stay bound from the old buffer until the frame ends, nothing is in flight in the new one
+	retired_.push_back(id_);
+	for (GLsync& fence : fences_) {
+		if (fence) {
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+	Create(frame_size);
+	head_ = 0;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <glad/glad.h>
+#include <vector>
+
+// Per-frame shader data (uniform blocks, storage buffers, indirect commands) in one persistently mapped
+// buffer split into `frame_count` segments. Each frame writes into the next segment with plain memcpys and
+// binds ranges of it; a fence per segment keeps the CPU from overwriting data the GPU hasn't read yet.
+// A frame that doesn't fit moves to a buffer twice the size, the old one is deleted at the next BeginFrame. Ranges
+// bound before stay valid, but offsets only refer to Id() until the next growth, see Reserve.
+class StreamBuffer
+{
+public:
+	StreamBuffer(size_t frame_size, unsigned int frame_count = 3);
+	~StreamBuffer();
+
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+	// Waits until the GPU is done with the segment this frame reuses
+	void BeginFrame();
+	// Fences the segment of this frame
+	void EndFrame();
+
+	// Copies `size` bytes into this frame's segment and returns their offset in Id(). Offsets are aligned for
+	// uniform and shader storage bindings.
+	size_t Write(const void* data, size_t size);
+	// Grows now if needed, so the next `writes` writes of `size` bytes in total all land in the same buffer
+	void Reserve(size_t size, unsigned int writes);
+	void BindRange(GLenum target, unsigned int binding, size_t offset, size_t size) const;
+
+	unsigned int Id() const;
+
+private:
+	unsigned int id_ = 0;
+	unsigned char* mapped_ = nullptr;
+	size_t frame_size_;
+	unsigned int frame_count_;
+	size_t alignment_ = 256;
+
+	unsigned int frame_ = 0;
+	size_t head_ = 0;
+	std::vector<GLsync> fences_;
+	std::vector<unsigned int> retired_;
+
+	void Create(size_t frame_size);
+	void Grow(size_t needed);
+};
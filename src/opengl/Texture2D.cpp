@@ -1,8 +1,11 @@
 #include "Texture2D.h"
 
+#include "../core/BlockCompression.h"
+
 #include <glad/glad.h>
 #include <stb_image.h>
 
+#include <algorithm>
 #include <iostream>
 #include <cassert>
 
@@ -15,6 +18,11 @@ Texture2D::Texture2D(const std::string& path)
 {
 	glGenTextures(1, &id_);
 
+	if (path.size() > 5 && path.compare(path.size() - 5, 5, ".btex") == 0) {
+		LoadCompressed(path);
+		return;
+	}
+
 	unsigned char* data = stbi_load(path.c_str(), &width_, &height_, &channels_, 0);
 	if (data)
 	{
@@ -166,4 +174,38 @@ void Texture2D::LoadTexture(const std::string& path)
 		std::cout << "Texture failed to load at path: " << path << std::endl;
 		stbi_image_free(data);
 	}
-}
\ No newline at end of file
+}
+
+void Texture2D::LoadCompressed(const std::string& path)
+{
+	BlockCompression::CompressedImage image;
+	if (!BlockCompression::ReadContainer(path, image)) {
+		std::cout << "ERROR::TEXTURE::FAILED_TO_LOAD_IMAGE " << path << std::endl;
+		return;
+	}
+
+	width_ = image.width;
+	height_ = image.height;
+	if (image.internal_format == GL_COMPRESSED_RED_RGTC1)
+		channels_ = 1;
+	else if (image.internal_format == GL_COMPRESSED_RG_RGTC2)
+		channels_ = 2;
+	else
+		channels_ = 4;
+
+	glBindTexture(GL_TEXTURE_2D, id_);
+	for (unsigned int mip = 0; mip < image.mips.size(); ++mip)
+	{
+		int mip_width = std::max(1, width_ >> mip);
+		int mip_height = std::max(1, height_ >> mip);
+		glCompressedTexImage2D(GL_TEXTURE_2D, mip, image.internal_format, mip_width, mip_height, 0,
+			static_cast<GLsizei>(image.mips[mip].size()), image.mips[mip].data());
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<int>(image.mips.size()) - 1);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	initialized_ = true;
+}
@@ -28,4 +28,6 @@ private:
 	bool initialized_ = false;
 
 	void LoadTexture(const std::string& path);
+	// Uploads a BCn .btex container (see tools/TextureCompress) with its precomputed mip chain
+	void LoadCompressed(const std::string& path);
 };
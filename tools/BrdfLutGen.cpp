@@ -0,0 +1,53 @@
+// Generates src/core/BrdfLutData.h, the split-sum BRDF lookup table embedded in the renderer.
+// The LUT only depends on the BRDF, never on the environment, so it is integrated once offline
+// with the CPU baker instead of at runtime.
+//
+// Build from the repository root, e.g.:
+//   g++ -std=c++17 -O2 -pthread -Isrc -I3rdparty/glad/include -I3rdparty/glm/include -I3rdparty/stb_image
+//       tools/BrdfLutGen.cpp src/core/IblBaker.cpp src/core/IblCache.cpp src/core/Hash.cpp -o BrdfLutGen
+//
+// Usage: BrdfLutGen [size=128] [sample_count=1024] [output=src/core/BrdfLutData.h]
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#include <glm/gtc/packing.hpp>
+
+#include <cstdio>
+#include <string>
+
+#include "core/IblBaker.h"
+
+int main(int argc, char** argv)
+{
+	unsigned int size = argc > 1 ? std::stoi(argv[1]) : 128;
+	unsigned int sample_count = argc > 2 ? std::stoi(argv[2]) : 1024;
+	std::string output = argc > 3 ? argv[3] : "src/core/BrdfLutData.h";
+
+	std::vector<float> lut = IblBaker::CreateBRDFLookup(size, sample_count);
+
+	FILE* file = std::fopen(output.c_str(), "w");
+	if (!file) {
+		std::printf("ERROR::BRDF_LUT_GEN::FAILED_TO_OPEN %s\n", output.c_str());
+		return 1;
+	}
+
+	std::fprintf(file, "#pragma once\n\n");
+	std::fprintf(file, "// Generated by tools/BrdfLutGen.cpp (%u samples), do not edit.\n", sample_count);
+	std::fprintf(file, "// Split-sum BRDF LUT as interleaved RG half floats, x is NdotV and y is roughness.\n\n");
+	std::fprintf(file, "#include <cstdint>\n\n");
+	std::fprintf(file, "namespace BrdfLutData {\n");
+	std::fprintf(file, "\tconst unsigned int kSize = %u;\n", size);
+	std::fprintf(file, "\tconst uint16_t kTexels[%zu] = {\n", lut.size());
+	for (size_t i = 0; i < lut.size(); ++i) {
+		if (i % 16 == 0) {
+			std::fprintf(file, "\t\t");
+		}
+		std::fprintf(file, "0x%04x,", glm::packHalf1x16(lut[i]));
+		std::fprintf(file, (i % 16 == 15 || i + 1 == lut.size()) ? "\n" : " ");
+	}
+	std::fprintf(file, "\t};\n}\n");
+	std::fclose(file);
+
+	std::printf("%s: %ux%u, %u samples\n", output.c_str(), size, size, sample_count);
+	return 0;
+}
@@ -0,0 +1,50 @@
+// Headless IBL baker. Bakes HDR environments on the CPU and writes them to the IBL cache
+// (cache/ibl, relative to the working directory) so the renderer picks them up without baking.
+//
+// Needs no GL context or GPU. Build from the repository root, e.g.:
+//   g++ -std=c++17 -O2 -msse2 -pthread -Isrc -I3rdparty/glad/include -I3rdparty/glm/include -I3rdparty/stb_image
+//       tools/IblBake.cpp src/core/IblBaker.cpp src/core/IblCache.cpp src/core/Hash.cpp -o IblBake
+//
+// Usage: IblBake <map.hdr> [more maps...]
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <chrono>
+#include <iostream>
+
+#include "core/IblBaker.h"
+#include "core/IblCache.h"
+
+int main(int argc, char** argv)
+{
+	if (argc < 2) {
+		std::cout << "Usage: IblBake <map.hdr> [more maps...]" << std::endl;
+		return 1;
+	}
+
+	Ibl::BakeSettings settings;
+	int failures = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string path = argv[i];
+		uint64_t key = IblCache::ComputeKey(path, settings);
+		if (key == 0) {
+			std::cout << "ERROR::IBL_BAKE::FAILED_TO_READ " << path << std::endl;
+			failures++;
+			continue;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		std::vector<CachedTexture> textures;
+		if (!IblBaker::Bake(path, settings, textures) || !IblCache::Store(key, textures)) {
+			std::cout << "ERROR::IBL_BAKE::FAILED " << path << std::endl;
+			failures++;
+			continue;
+		}
+		auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << path << " -> " << IblCache::PathForKey(key) << " (" << elapsed << " s)" << std::endl;
+	}
+
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,133 @@
+// Offline BCn encoder for material maps. Writes a .btex container with the full mip chain that
+// Texture2D and TextureStreamer upload with glCompressedTex(Sub)Image2D. The streamer picks up
+// <name>.btex in place of <name>.png automatically when it exists next to it.
+//
+// Images are flipped vertically on load like the renderer's PNG path, pass --no-flip to keep them as stored.
+// Blocks are encoded on all hardware threads. Build from the repository root, e.g.:
+//   g++ -std=c++17 -O2 -msse2 -pthread -Isrc -I3rdparty/glad/include -I3rdparty/stb_image
+//       tools/TextureCompress.cpp src/core/BlockCompression.cpp -o TextureCompress
+//
+// Usage: TextureCompress <bc4|bc5|bc7> <input> [output] [--no-flip]
+//        TextureCompress orm <occlusion|-> <roughness|-> <metallic|-> <output> [--no-flip]
+//   bc4: scalar maps (metallic, roughness, AO), bc5: normal maps, bc7: albedo
+//   orm: packs the three scalar maps into the R, G and B channels and encodes them as BC7, `-` skips a map
+//        (see TextureStreamer::LoadOrm and USE_ORM_MAP in pbr.frag)
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "core/BlockCompression.h"
+
+namespace {
+	bool LoadImage(const std::string& path, BlockCompression::Image& image)
+	{
+		int width = 0, height = 0, channels = 0;
+		unsigned char* data = stbi_load(path.c_str(), &width, &height, &channels, 0);
+		if (!data) {
+			std::cout << "ERROR::TEXTURE_COMPRESS::FAILED_TO_LOAD_IMAGE " << path << std::endl;
+			return false;
+		}
+
+		image.width = width;
+		image.height = height;
+		image.channels = channels;
+		image.pixels.assign(data, data + static_cast<size_t>(width) * height * channels);
+		stbi_image_free(data);
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> args;
+	bool flip = true;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--no-flip") {
+			flip = false;
+		}
+		else {
+			args.push_back(arg);
+		}
+	}
+
+	bool orm = !args.empty() && args[0] == "orm";
+	if (args.size() < (orm ? 5u : 2u)) {
+		std::cout << "Usage: TextureCompress <bc4|bc5|bc7> <input> [output] [--no-flip]" << std::endl;
+		std::cout << "       TextureCompress orm <occlusion|-> <roughness|-> <metallic|-> <output> [--no-flip]" << std::endl;
+		return 1;
+	}
+
+	BlockCompression::Format format;
+	if (orm) {
+		format = BlockCompression::Format::BC7;
+	}
+	else if (args[0] == "bc4") {
+		format = BlockCompression::Format::BC4;
+	}
+	else if (args[0] == "bc5") {
+		format = BlockCompression::Format::BC5;
+	}
+	else if (args[0] == "bc7") {
+		format = BlockCompression::Format::BC7;
+	}
+	else {
+		std::cout << "ERROR::TEXTURE_COMPRESS::UNKNOWN_FORMAT " << args[0] << std::endl;
+		return 1;
+	}
+
+	std::string input = args[1];
+	std::string output;
+	stbi_set_flip_vertically_on_load(flip);
+
+	BlockCompression::Image image;
+	if (orm) {
+		BlockCompression::Image maps[3];
+		for (int i = 0; i < 3; ++i) {
+			if (args[i + 1] != "-" && !LoadImage(args[i + 1], maps[i])) {
+				return 1;
+			}
+		}
+		BlockCompression::Channel channels[3];
+		for (int i = 0; i < 3; ++i) {
+			channels[i].image = args[i + 1] != "-" ? &maps[i] : nullptr;
+		}
+		image = BlockCompression::PackOrm(channels[0], channels[1], channels[2]);
+		if (image.pixels.empty()) {
+			return 1;
+		}
+		input = "orm";
+		output = args[4];
+	}
+	else {
+		if (!LoadImage(input, image)) {
+			return 1;
+		}
+		output = args.size() > 2 ? args[2] : input.substr(0, input.find_last_of('.')) + ".btex";
+	}
+	unsigned int width = image.width;
+	unsigned int height = image.height;
+
+	auto start = std::chrono::steady_clock::now();
+	BlockCompression::CompressedImage compressed;
+	compressed.internal_format = BlockCompression::InternalFormat(format);
+	compressed.width = width;
+	compressed.height = height;
+	size_t bytes = 0;
+	for (const BlockCompression::Image& mip : BlockCompression::GenerateMipChain(std::move(image))) {
+		compressed.mips.push_back(BlockCompression::Encode(format, mip));
+		bytes += compressed.mips.back().size();
+	}
+	auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if (!BlockCompression::WriteContainer(output, compressed)) {
+		return 1;
+	}
+	std::cout << input << " -> " << output << " (" << width << "x" << height << ", " << compressed.mips.size() << " mips, "
+		<< bytes / 1024 << " KB, " << elapsed << " s)" << std::endl;
+	return 0;
+}